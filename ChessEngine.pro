@@ -1,22 +1,44 @@
 QMAKE_CXXFLAGS += -std=c++11
 QT += gui core widgets
 
+# slider attacks use magic bitboards by default,
+# build with "qmake CONFIG+=pext" to use BMI2 PEXT lookups instead
+pext {
+    DEFINES += USE_PEXT
+    QMAKE_CXXFLAGS += -mbmi2
+}
+
+# "qmake CONFIG+=verify_keys" recomputes the position key, the piece-square scores
+# and the network accumulator after every make/unmake
+verify_keys {
+    DEFINES += VERIFY_KEYS
+}
+
 SOURCES += main.cpp \
     board.cpp \
+    bitboard.cpp \
+    zobrist.cpp \
     UI/uiboard.cpp \
     engine.cpp \
     abstractthread.cpp \
     search.cpp \
-    evaluate.cpp
+    transpositiontable.cpp \
+    evaluate.cpp \
+    nnue.cpp
 
 HEADERS += \
     board.h \
+    bitboard.h \
+    zobrist.h \
+    psqt.h \
     UI/uiboard.h \
     enginetypes.h \
     engine.h \
     abstractthread.h \
     search.h \
-    evaluate.h
+    transpositiontable.h \
+    evaluate.h \
+    nnue.h
 
 RESOURCES += \
     UI/Images.qrc
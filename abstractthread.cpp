@@ -1,5 +1,4 @@
 #include "abstractthread.h"
-#include <QDebug>
 
 AbstractThread::AbstractThread()
     : thread(), started(false), terminating(false)
@@ -25,13 +24,8 @@ bool AbstractThread::isFinished() {
 
 void AbstractThread::waitForFinish()
 {
-    int count = 0;
-    while (isRunning()) {
-        if (count++)
-            qDebug() << "waitFinish(): wake-up #" << count;
-        std::unique_lock<std::mutex> lck(mutex);
-        lck.unlock();
-    }
+    std::unique_lock<std::mutex> lck(mutex);
+    finishedCv.wait(lck, [this](){return !started;}); // blocks until RUNNING -> IDLE
 }
 
 AbstractThread::~AbstractThread() {
@@ -59,5 +53,7 @@ void AbstractThread::abstract_thread_main() {
         run();
 
         started = false;    // state change RUNNING -> IDLE
+        lck.unlock();
+        finishedCv.notify_all(); // wakes up waitForFinish()
     }
 }
@@ -33,6 +33,7 @@ protected:
     std::thread thread;
     std::mutex mutex;
     std::condition_variable cv;
+    std::condition_variable finishedCv;
 
     volatile bool started;
     volatile bool terminating;
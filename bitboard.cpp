@@ -0,0 +1,164 @@
+#include "bitboard.h"
+
+namespace Chess {
+namespace Bitboards {
+
+Magic rookMagics[64];
+Magic bishopMagics[64];
+
+Bitboard knightAttacks[64];
+Bitboard kingAttacks[64];
+Bitboard pawnAttacks[2][64];
+
+Bitboard betweenBB[64][64];
+Bitboard lineBB[64][64];
+
+namespace {
+
+Bitboard rookTable[0x19000];  // sum of 2^(relevant bits) over all squares
+Bitboard bishopTable[0x1480];
+
+/* xorshift64* generator, only used to look for magic numbers */
+class Random {
+    std::uint64_t s;
+public:
+    explicit Random(std::uint64_t seed) : s(seed) {}
+
+    std::uint64_t next() {
+        s ^= s >> 12;
+        s ^= s << 25;
+        s ^= s >> 27;
+        return s * 2685821657736338717ULL;
+    }
+
+    // numbers with few bits set make better magic candidates
+    std::uint64_t sparse() {
+        return next() & next() & next();
+    }
+};
+
+Bitboard stepAttacks(Coord square, const sint8 (*offsets)[2], int count) {
+    Bitboard result = 0;
+    for (int i = 0; i < count; ++i) {
+        Coord to(square.file() + offsets[i][0], square.rank() + offsets[i][1]);
+        if (to.isValid())
+            result |= squareBB(to);
+    }
+    return result;
+}
+
+/* slow ray walk, used only to fill the lookup tables */
+Bitboard slidingAttacks(Piece::Type type, Coord square, Bitboard occupied) {
+    static const sint8 rookDirections[4][2]   = { {0,+1}, {+1,0}, {0,-1}, {-1,0} };
+    static const sint8 bishopDirections[4][2] = { {+1,+1}, {+1,-1}, {-1,-1}, {-1,+1} };
+    const sint8 (*directions)[2] = (type == Piece::Rook ? rookDirections : bishopDirections);
+
+    Bitboard result = 0;
+    for (int i = 0; i < 4; ++i) {
+        Coord to = square;
+        while (true) {
+            to = Coord(to.file() + directions[i][0], to.rank() + directions[i][1]);
+            if (!to.isValid())
+                break;
+            result |= squareBB(to);
+            if (occupied & squareBB(to))
+                break;
+        }
+    }
+    return result;
+}
+
+void initMagics(Piece::Type type, Bitboard table[], Magic magics[]) {
+    Bitboard occupancy[4096];
+    Bitboard reference[4096];
+    int epoch[4096] = {};
+    int attempt = 0;
+    Random rng(0x2545F4914F6CDD1DULL);
+
+    Bitboard *attacks = table;
+    for (int index = 0; index < 64; ++index) {
+        Coord square(index);
+        Magic &m = magics[index];
+
+        // board edges are not relevant for the occupancy unless the piece stands on them
+        Bitboard edges = ((Rank1 | Rank8) & ~rankBB(square)) | ((FileA | FileH) & ~fileBB(square));
+
+        m.mask    = slidingAttacks(type, square, 0) & ~edges;
+        m.shift   = 64 - popCount(m.mask);
+        m.attacks = attacks;
+
+        // enumerate all subsets of the mask (Carry-Rippler trick)
+        int size = 0;
+        Bitboard b = 0;
+        do {
+            occupancy[size] = b;
+            reference[size] = slidingAttacks(type, square, b);
+#ifdef USE_PEXT
+            m.attacks[m.index(b)] = reference[size];
+#endif
+            size++;
+            b = (b - m.mask) & m.mask;
+        } while (b);
+
+        attacks += size;
+
+#ifndef USE_PEXT
+        // try random sparse candidates until one maps every subset without destructive collisions
+        for (int i = 0; i < size; ) {
+            for (m.magic = 0; popCount((m.magic * m.mask) >> 56) < 6; )
+                m.magic = rng.sparse();
+
+            for (++attempt, i = 0; i < size; ++i) {
+                unsigned idx = m.index(occupancy[i]);
+                if (epoch[idx] < attempt) {
+                    epoch[idx] = attempt;
+                    m.attacks[idx] = reference[i];
+                } else if (m.attacks[idx] != reference[i]) {
+                    break;
+                }
+            }
+        }
+#endif
+    }
+}
+
+struct Initializer {
+    Initializer() { init(); }
+} initializer;
+
+} // !anonymous namespace
+
+void init()
+{
+    static const sint8 knightOffsets[8][2] = { {+1,+2}, {+2,+1}, {+2,-1}, {+1,-2}, {-1,-2}, {-2,-1}, {-2,+1}, {-1,+2} };
+    static const sint8 kingOffsets[8][2]   = { {0,+1}, {+1,+1}, {+1,0}, {+1,-1}, {0,-1}, {-1,-1}, {-1,0}, {-1,+1} };
+    static const sint8 whitePawnOffsets[2][2] = { {-1,+1}, {+1,+1} };
+    static const sint8 blackPawnOffsets[2][2] = { {-1,-1}, {+1,-1} };
+
+    for (int index = 0; index < 64; ++index) {
+        Coord square(index);
+        knightAttacks[index] = stepAttacks(square, knightOffsets, 8);
+        kingAttacks[index]   = stepAttacks(square, kingOffsets, 8);
+        pawnAttacks[Piece::White][index] = stepAttacks(square, whitePawnOffsets, 2);
+        pawnAttacks[Piece::Black][index] = stepAttacks(square, blackPawnOffsets, 2);
+    }
+
+    initMagics(Piece::Rook,   rookTable,   rookMagics);
+    initMagics(Piece::Bishop, bishopTable, bishopMagics);
+
+    for (int a = 0; a < 64; ++a) {
+        for (int b = 0; b < 64; ++b) {
+            if (a == b)
+                continue;
+            for (Piece::Type type : {Piece::Bishop, Piece::Rook}) {
+                if (slidingAttacks(type, a, 0) & squareBB(b)) {
+                    lineBB[a][b]    = (slidingAttacks(type, a, 0) & slidingAttacks(type, b, 0)) | squareBB(a) | squareBB(b);
+                    betweenBB[a][b] = slidingAttacks(type, a, squareBB(b)) & slidingAttacks(type, b, squareBB(a));
+                }
+            }
+        }
+    }
+}
+
+} // !namespace Bitboards
+} // !namespace Chess
@@ -0,0 +1,120 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include "enginetypes.h"
+
+#ifdef USE_PEXT
+#include <immintrin.h>
+#endif
+
+namespace Chess {
+
+using Bitboard = std::uint64_t;
+
+namespace Bitboards {
+
+constexpr Bitboard FileA = 0x0101010101010101ULL;
+constexpr Bitboard FileH = FileA << 7;
+constexpr Bitboard Rank1 = 0xFFULL;
+constexpr Bitboard Rank8 = Rank1 << 56;
+
+constexpr Bitboard squareBB(Coord square) {
+    return Bitboard(1) << square;
+}
+
+constexpr Bitboard fileBB(Coord square) {
+    return FileA << square.file();
+}
+
+constexpr Bitboard rankBB(Coord square) {
+    return Rank1 << (8 * square.rank());
+}
+
+inline int popCount(Bitboard b) {
+    return __builtin_popcountll(b);
+}
+
+/* least significant set square, b must not be empty */
+inline Coord lsb(Bitboard b) {
+    return Coord(sint8(__builtin_ctzll(b)));
+}
+
+inline Coord popLsb(Bitboard &b) {
+    Coord square = lsb(b);
+    b &= b - 1;
+    return square;
+}
+
+inline bool moreThanOne(Bitboard b) {
+    return b & (b - 1);
+}
+
+/* Sliding attacks lookup entry for a single square.
+ * The relevant occupancy is mapped to an index either by the magic
+ * multiplication or, when built with USE_PEXT, by the BMI2 PEXT instruction. */
+struct Magic {
+    Bitboard  mask;
+    Bitboard  magic;
+    Bitboard *attacks;
+    unsigned  shift;
+
+    inline unsigned index(Bitboard occupied) const {
+#ifdef USE_PEXT
+        return unsigned(_pext_u64(occupied, mask));
+#else
+        return unsigned(((occupied & mask) * magic) >> shift);
+#endif
+    }
+};
+
+extern Magic rookMagics[64];
+extern Magic bishopMagics[64];
+
+extern Bitboard knightAttacks[64];
+extern Bitboard kingAttacks[64];
+extern Bitboard pawnAttacks[2][64];   // [color of the pawn][square]
+
+extern Bitboard betweenBB[64][64];    // squares strictly between two aligned squares
+extern Bitboard lineBB[64][64];       // whole board line through two aligned squares
+
+inline Bitboard between(Coord a, Coord b) {
+    return betweenBB[a][b];
+}
+
+inline Bitboard line(Coord a, Coord b) {
+    return lineBB[a][b];
+}
+
+inline Bitboard rookAttacks(Coord square, Bitboard occupied) {
+    const Magic &m = rookMagics[square];
+    return m.attacks[m.index(occupied)];
+}
+
+inline Bitboard bishopAttacks(Coord square, Bitboard occupied) {
+    const Magic &m = bishopMagics[square];
+    return m.attacks[m.index(occupied)];
+}
+
+inline Bitboard queenAttacks(Coord square, Bitboard occupied) {
+    return rookAttacks(square, occupied) | bishopAttacks(square, occupied);
+}
+
+/* attacks of a non-pawn piece type standing on square */
+inline Bitboard attacks(Piece::Type type, Coord square, Bitboard occupied) {
+    switch (type) {
+    case Piece::Knight: return knightAttacks[square];
+    case Piece::Bishop: return bishopAttacks(square, occupied);
+    case Piece::Rook:   return rookAttacks(square, occupied);
+    case Piece::Queen:  return queenAttacks(square, occupied);
+    case Piece::King:   return kingAttacks[square];
+    default:            return 0;
+    }
+}
+
+// fills the tables above, called once at startup by a static initializer
+void init();
+
+} // !namespace Bitboards
+} // !namespace Chess
+
+#endif // BITBOARD_H
@@ -1,4 +1,7 @@
 #include "board.h"
+#include "evaluate.h"
+#include <cstdlib>
+#include <cstring>
 #include <sstream>
 
 namespace Chess {
@@ -31,7 +34,9 @@ Board Board::fromFEN(std::string fenRecord)
 
             char name = std::toupper(ch);
             if (name == 'P') {
-                piece = Piece(Piece::Pawn, std::isupper(ch) ? Piece::White : Piece::Black);
+                // a pawn away from its starting rank must have moved already
+                bool moved = (rank != (std::isupper(ch) ? 1 : 6));
+                piece = Piece(Piece::Pawn, std::isupper(ch) ? Piece::White : Piece::Black, moved);
             } else if (name == 'N') {
                 piece = Piece(Piece::Knight, std::isupper(ch) ? Piece::White : Piece::Black);
             } else if (name == 'B') {
@@ -53,347 +58,536 @@ Board Board::fromFEN(std::string fenRecord)
     if (records.size() >= 2)
         board.m_sideToMove = records[1] == "b" ? Piece::Black : Piece::White;
 
+    /* get castling rights, without the field kings and rooks are left unmoved */
+    if (records.size() >= 3) {
+        const string &rights = records[2];
+        for (int index = 0; index < 64; ++index) {
+            Piece piece = board.squares[index];
+            if (!piece.isKing() && !piece.isRook())
+                continue;
+
+            Coord square(index);
+            bool white    = piece.isWhite();
+            bool homeRank = square.rank() == (white ? 0 : 7);
+            bool kingSide  = rights.find(white ? 'K' : 'k') != string::npos;
+            bool queenSide = rights.find(white ? 'Q' : 'q') != string::npos;
+
+            bool unmoved = false;
+            if (piece.isKing())
+                unmoved = homeRank && square.file() == 4 && (kingSide || queenSide);
+            else if (square.file() == 7)
+                unmoved = homeRank && kingSide;
+            else if (square.file() == 0)
+                unmoved = homeRank && queenSide;
+
+            piece.setMoved(!unmoved);
+            board.setPiece(square, piece);
+        }
+    }
+
+    /* get en passant target square */
+    if (records.size() >= 4 && records[3].size() == 2)
+        board.m_fenEnPassant = Coord(records[3][0] - 'a', records[3][1] - '1');
+
+    /* get halfmove clock, the fullmove number is not used */
+    if (records.size() >= 5)
+        board.m_halfmoveClock = std::max(0, std::atoi(records[4].c_str()));
+
+    board.m_key = board.computeKey();
 
     return board;
 }
 
-/* TODO: Add enpassant attacker check */
-bool Board::isSquareAttacked(Coord square, Piece::Color attackingSide)
+bool Board::isSquareAttacked(Coord square, Piece::Color attackingSide) const
 {
-    for (int direction=North; direction < DirectionMax; direction += Rotate_45_Degree) {
-
-        int distance = 0;
-        Coord from = square;
-
-        while (from.isValid()) {
-
-            switch (direction) {
-            case East:      from = from.nextFile(); break;
-            case West:      from = from.prevFile(); break;
-            case North:     from = from.nextRank(); break;
-            case South:     from = from.prevRank(); break;
-            case NorthEast: from = from.nextDiagMain(); break;
-            case SouthWest: from = from.prevDiagMain(); break;
-            case NorthWest: from = from.nextDiagAnti(); break;
-            case SouthEast: from = from.prevDiagAnti(); break;
-            }
+    return attackersTo(square, pieces()) & pieces(attackingSide);
+}
 
-            distance++;
+/* all pieces of both colors attacking square, sliders see through the given occupancy */
+Bitboard Board::attackersTo(Coord square, Bitboard occupied) const
+{
+    using namespace Bitboards;
+    return (pawnAttacks[Piece::Black][square] & pieces(Piece::Pawn, Piece::White))
+         | (pawnAttacks[Piece::White][square] & pieces(Piece::Pawn, Piece::Black))
+         | (knightAttacks[square] & pieces(Piece::Knight))
+         | (kingAttacks[square] & pieces(Piece::King))
+         | (bishopAttacks(square, occupied) & (pieces(Piece::Bishop) | pieces(Piece::Queen)))
+         | (rookAttacks(square, occupied) & (pieces(Piece::Rook) | pieces(Piece::Queen)));
+}
 
-            if (!from.isValid())
-                break;
+/* pieces of side that are the only blocker between an enemy slider and the king on kingSquare */
+Bitboard Board::pinnedPieces(Piece::Color side, Coord kingSquare) const
+{
+    using namespace Bitboards;
+    Bitboard pinned = 0;
+    Bitboard snipers = ((rookAttacks(kingSquare, 0) & (pieces(Piece::Rook) | pieces(Piece::Queen)))
+                      | (bishopAttacks(kingSquare, 0) & (pieces(Piece::Bishop) | pieces(Piece::Queen))))
+                      & pieces(!side);
+
+    while (snipers) {
+        Bitboard blockers = between(kingSquare, popLsb(snipers)) & pieces();
+        if (blockers && !moreThanOne(blockers) && (blockers & pieces(side)))
+            pinned |= blockers;
+    }
+    return pinned;
+}
 
-            if (isOccupied(from)) {
-                if (squares[from].color() == attackingSide) {
-                    Piece attacker = squares[from];
-                    switch(direction) {
-                    case North: case South: case East: case West: {
-                        if ( attacker.isRook() || attacker.isQueen() )
-                            return true;
-                        else if (distance == 1 && attacker.isKing())
-                            return true;
-                        break;
-                    }
-                    case NorthEast: case SouthWest: case NorthWest: case SouthEast: {
-                        if ( attacker.isBishop() || attacker.isQueen() ) {
-                            return true;
-                        } else if (distance == 1 && attacker.isKing()){
-                            return true;
-                        } else if (distance == 1 && attacker.isPawn()) {
-                            if (attacker.isWhite() && (direction == SouthEast || direction == SouthWest))
-                                return true;
-                            else if (attacker.isBlack() && (direction == NorthEast || direction == NorthWest))
-                                return true;
-                        }
-                        break;
-                    }
-                    }
-                }
-                break; //  if (isOccupied(from))
-            }
-        }
+Coord Board::enPassantSquare() const
+{
+    if (movesDone.size() == 0)
+        return m_fenEnPassant;
+
+    Move last = movesDone.back();
+    if ((last.flags() & Move::PawnMoveFlag) && last.type() == Move::DoubleStep)
+        return Coord( (last.origin() + last.target()) / 2 );
+    return Coord();
+}
+
+/* castling rights follow from the moved bits of the kings and rooks on their home squares */
+int Board::castlingRights() const
+{
+    int rights = 0;
+    for (int color = Piece::White; color <= Piece::Black; ++color) {
+        int rank = (color == Piece::White ? 0 : 7);
+        Piece king = squares[Coord(4, rank)];
+        if (!king.isKing() || king.moved() || king.color() != color)
+            continue;
+
+        Piece rookRight = squares[Coord(7, rank)];
+        Piece rookLeft  = squares[Coord(0, rank)];
+        if (rookRight.isRook() && !rookRight.moved() && rookRight.color() == color)
+            rights |= (color == Piece::White ? Zobrist::WhiteKingSide : Zobrist::BlackKingSide);
+        if (rookLeft.isRook() && !rookLeft.moved() && rookLeft.color() == color)
+            rights |= (color == Piece::White ? Zobrist::WhiteQueenSide : Zobrist::BlackQueenSide);
     }
+    return rights;
+}
 
-    /* Knight's offsets clockwise */
-    Coord knightAttacker;
-    static const sint8 knightOffsets[8][2] = { {+1,+2}, {+2,+1}, {+2,-1}, {+1,-2}, {-1,-2}, {-2,-1}, {-2,+1}, {-1,+2} };
-    for (size_t i=0; i < 8; ++i) {
-        knightAttacker = Coord( square.file() + knightOffsets[i][0], square.rank() + knightOffsets[i][1]);
-        if (knightAttacker.isValid() && squares[knightAttacker].isKnight() && squares[knightAttacker].color() == attackingSide)
-            return true;
+/* the en passant square is hashed only when the side to move can actually capture on it */
+Key Board::enPassantKey() const
+{
+    Coord enPassant = enPassantSquare();
+    if (enPassant.isValid() && (Bitboards::pawnAttacks[!m_sideToMove][enPassant] & pieces(Piece::Pawn, m_sideToMove)))
+        return Zobrist::enPassantFile[enPassant.file()];
+    return 0;
+}
+
+Key Board::computeKey() const
+{
+    Key key = 0;
+    for (int index = 0; index < 64; ++index)
+        key ^= Zobrist::piece(squares[index], index);
+
+    if (m_sideToMove == Piece::Black)
+        key ^= Zobrist::side;
+
+    return key ^ Zobrist::castling[castlingRights()] ^ enPassantKey();
+}
+
+Key Board::computePawnKey() const
+{
+    Key key = 0;
+    Bitboard pawns = pieces(Piece::Pawn);
+    while (pawns) {
+        Coord square = Bitboards::popLsb(pawns);
+        key ^= Zobrist::piece(squares[square], square);
     }
+    return key;
+}
 
+void Board::computePsq(Score &psq, int &phase) const
+{
+    psq = Score();
+    phase = 0;
+    for (int index = 0; index < 64; ++index) {
+        Piece piece = squares[index];
+        psq += Psqt::piece(piece, Coord(index));
+        phase += Psqt::PhaseWeight[piece.type()];
+    }
+}
 
-    return false;
+void Board::computeAccumulator(Nnue::Accumulator &accumulator) const
+{
+    accumulator = Nnue::Accumulator();
+    for (int index = 0; index < 64; ++index)
+        if (!squares[index].isEmpty())
+            Nnue::addPiece(accumulator, squares[index], Coord(index));
 }
 
-/* TODO: optimize, looks silly, should be faster */
-bool Board::isKingAttacked(Piece::Color side)
+void Board::refreshAccumulator()
 {
-    for (int i = 0; i < 64; ++i) {
-        if (squares[i].isKing() && squares[i].color() == side) {
-            return isSquareAttacked(i, !side);
-        }
+    if (Nnue::isLoaded())
+        computeAccumulator(m_accumulator);
+}
+
+void Board::verifyState() const
+{
+#ifdef VERIFY_KEYS
+    if (m_key != computeKey())
+        qDebug() << "Board::verifyState() incremental key mismatch: should never happen!";
+    if (m_pawnKey != computePawnKey())
+        qDebug() << "Board::verifyState() incremental pawn key mismatch: should never happen!";
+
+    Score psq;
+    int phase;
+    computePsq(psq, phase);
+    if (!(psq == m_psq) || phase != m_phase)
+        qDebug() << "Board::verifyState() incremental piece-square score mismatch: should never happen!";
+
+    if (Nnue::isLoaded()) {
+        Nnue::Accumulator accumulator;
+        computeAccumulator(accumulator);
+        if (std::memcmp(&accumulator, &m_accumulator, sizeof(accumulator)))
+            qDebug() << "Board::verifyState() incremental accumulator mismatch: should never happen!";
+        if (Nnue::evaluate(m_accumulator, m_sideToMove) != Nnue::evaluateScalar(m_accumulator, m_sideToMove))
+            qDebug() << "Board::verifyState() SIMD and scalar network output differ: should never happen!";
     }
-    return false;
+#endif
 }
 
+/* Only positions with the same side to move can repeat, and none before the
+ * last capture, pawn move or null move, so at most halfmoveClock / 2 keys are
+ * compared. */
+bool Board::isRepetition() const
+{
+    int distance = std::min(m_halfmoveClock, m_pliesFromNull);
+    for (int i = 4; i <= distance; i += 2)
+        if (previousStates[previousStates.size() - i].key == m_key)
+            return true;
+    return false;
+}
 
+bool Board::isDraw() const
+{
+    if (m_halfmoveClock >= 100) {
+        if (!isKingAttacked(m_sideToMove))
+            return true;
+        MoveList movesList;
+        possibleMoves(m_sideToMove, movesList);
+        return movesList.size() > 0;
+    }
+    return isRepetition();
+}
 
-Vector<Move> Board::possibleMoves(const Coord from)
+bool Board::isKingAttacked(Piece::Color side) const
 {
-    Vector<Move> movesList;
-    Piece piece = squares[from];
-    Coord to;
+    Coord square = kingSquares[side];
+    return square.isValid() && isSquareAttacked(square, !side);
+}
 
-    if (piece.isPawn() ) {
-        /* Pawn Move */
-        to = (piece.isWhite() ? from.nextRank() : from.prevRank() );
-        if (to.isValid() && !isOccupied(to)) {
-            // Handle Promotion
-            if (to.rank() == (piece.isWhite() ? 7 : 0) ) {
-                uint8 moveFlags = piece.moved() ? Move::PawnMoveFlag : Move::PawnMoveFlag | Move::FirstMoveFlag;
-                movesList.emplace_back(from, to, moveFlags, Move::PromoteToQueen);
-                movesList.emplace_back(from, to, moveFlags, Move::PromoteToKnight);
-                movesList.emplace_back(from, to, moveFlags, Move::PromoteToRook);
-                movesList.emplace_back(from, to, moveFlags, Move::PromoteToBishop);
-            } else {
-                movesList.emplace_back(from, to, !piece.moved(), false);
-            }
-        }
 
-        if (!piece.moved() ) {
-            /* Pawn double move */
-            to = (piece.isWhite() ? from.nextRank() : from.prevRank() );
-            if (to.isValid() && !isOccupied(to) ) {
-                to = (piece.isWhite()) ? to.nextRank() : to.prevRank();
-                if (to.isValid() && !isOccupied(to) ) {
-                    movesList.emplace_back(from, to, Move::FirstMoveFlag | Move::PawnMoveFlag, Move::DoubleStep);
-                }
-            }
-        }
 
-        /* Pawn Takes Left */
-        to = (piece.isWhite() ? from.nextDiagAnti() : from.prevDiagAnti() );
-        if (to.isValid() && isOccupied(to) && squares[to].color() != piece.color() ) {
-            // Handle Promotion
-            if (to.rank() == (piece.isWhite() ? 7 : 0) ) {
-                uint8 moveFlags = piece.moved() ? Move::PawnMoveFlag : Move::PawnMoveFlag | Move::FirstMoveFlag;
-                moveFlags |= Move::CaptureFlag;
-                movesList.emplace_back(from, to, moveFlags, Move::PromoteToQueen);
-                movesList.emplace_back(from, to, moveFlags, Move::PromoteToKnight);
-                movesList.emplace_back(from, to, moveFlags, Move::PromoteToRook);
-                movesList.emplace_back(from, to, moveFlags, Move::PromoteToBishop);
-            } else {
-                movesList.emplace_back(from, to, !piece.moved(), true);
-            }
-        }
+Vector<Move> Board::possibleMoves(const Coord from) const
+{
+    MoveList movesList;
+    possibleMoves(from, movesList);
+    return Vector<Move>(movesList.begin(), movesList.end());
+}
 
-        /* Pawn Takes Right */
-        to = (piece.isWhite() ? from.nextDiagMain() : from.prevDiagMain() );
-        if (to.isValid() && isOccupied(to) && !piece.sameColor(squares[to]) ) {
-            // Handle Promotion
-            if (to.rank() == (piece.isWhite() ? 7 : 0) ) {
-                uint8 moveFlags = piece.moved() ? Move::PawnMoveFlag : Move::PawnMoveFlag | Move::FirstMoveFlag;
-                moveFlags |= Move::CaptureFlag;
-                movesList.emplace_back(from, to, moveFlags, Move::PromoteToQueen);
-                movesList.emplace_back(from, to, moveFlags, Move::PromoteToKnight);
-                movesList.emplace_back(from, to, moveFlags, Move::PromoteToRook);
-                movesList.emplace_back(from, to, moveFlags, Move::PromoteToBishop);
-            } else {
-                movesList.emplace_back(from, to, !piece.moved(), true);
-            }
-        }
+Vector<Move> Board::possibleMoves(Piece::Color forSide) const
+{
+    MoveList movesList;
+    possibleMoves(forSide, movesList);
+    return Vector<Move>(movesList.begin(), movesList.end());
+}
 
-        /* En Passant */
-        if (movesDone.size() > 0 && (movesDone.back().flags() & Move::PawnMoveFlag) && movesDone.back().type() == Move::DoubleStep) {
-            Coord enPasPawn = movesDone.back().target();
+void Board::possibleMoves(const Coord from, MoveList &movesList) const
+{
+    Piece piece = squares[from];
+    if (piece.isEmpty())
+        return;
 
-            if (from.sameRank(enPasPawn) && from.chebyshevDistance(enPasPawn) == 1) {
-                uint8 moveFlags = piece.moved() ? Move::PawnMoveFlag : Move::PawnMoveFlag | Move::FirstMoveFlag;
-                moveFlags |= Move::CaptureFlag;
-                to = (squares[enPasPawn].isWhite() ? enPasPawn.prevRank() : enPasPawn.nextRank() );
-                movesList.emplace_back(from, to, moveFlags, Move::EnPassant);
-            }
-        }
+    MoveList sideMoves;
+    possibleMoves(piece.color(), sideMoves);
+    for (Move move : sideMoves) {
+        if (move.origin() == from)
+            movesList.push_back(move);
     }
+}
 
-    if (piece.isKing()) {
-
-        for (int direction=North; direction < DirectionMax; direction += Rotate_45_Degree) {
-            switch (direction) {
-            case East:      to = from.nextFile(); break;
-            case West:      to = from.prevFile(); break;
-            case North:     to = from.nextRank(); break;
-            case South:     to = from.prevRank(); break;
-            case NorthEast: to = from.nextDiagMain(); break;
-            case SouthWest: to = from.prevDiagMain(); break;
-            case NorthWest: to = from.nextDiagAnti(); break;
-            case SouthEast: to = from.prevDiagAnti(); break;
-            default: ; // honestly it really should not happen
-            }
+/* Emits legal moves only: checkers and pinned pieces are computed once per
+ * position instead of making every pseudo-legal move and testing the king. */
+void Board::possibleMoves(Piece::Color forSide, MoveList &movesList) const
+{
+    Coord kingSquare = kingSquares[forSide];
+    if (!kingSquare.isValid())
+        return;  // without a king there is nothing to keep legal, treat as no moves
+
+    Bitboard checkers = attackersTo(kingSquare, pieces()) & pieces(!forSide);
+    Bitboard pinned   = pinnedPieces(forSide, kingSquare);
+
+    if (checkers) {
+        generateEvasions(forSide, kingSquare, checkers, pinned, movesList);
+    } else {
+        generatePieceMoves(forSide, kingSquare, ~pieces(forSide), pinned, movesList);
+        generatePawnMoves(forSide, kingSquare, ~pieces(forSide), pinned, movesList);
+        generateKingMoves(forSide, kingSquare, ~pieces(forSide), movesList);
+        generateCastling(forSide, kingSquare, movesList);
+    }
+}
 
-            if (to.isValid() && (!isOccupied(to) || (isOccupied(to) && !piece.sameColor(squares[to]) )))
-                movesList.emplace_back(from, to, !piece.moved(), isOccupied(to));
-        }
+/* Same as possibleMoves() restricted to the moves changing the material,
+ * quiet moves are kept only as evasions since a position in check can't be left unresolved */
+void Board::possibleCaptures(Piece::Color forSide, MoveList &movesList) const
+{
+    Coord kingSquare = kingSquares[forSide];
+    if (!kingSquare.isValid())
+        return;
 
-        /* Castling */
-        if (!piece.moved() ) {
-            Coord castleLeft  = Coord(2, from.rank() );
-            Coord castleRight = Coord(6, from.rank() );
-            Coord rookLeft    = Coord(0, from.rank() );
-            Coord rookRight   = Coord(7, from.rank() );
-
-            if (squares[rookLeft].isRook() && !squares[rookLeft].moved() ) {
-                bool canCastleLeft= true;
-                for (Coord path = from.prevFile(); path != rookLeft; path = path.prevFile() ) {
-                    if (isOccupied(path)) {
-                        canCastleLeft = false;
-                        break;
-                    }
-                }
-
-                for (Coord path = from; path != castleLeft; path = path.prevFile() ) {
-                    if (isSquareAttacked(path, !piece.color() )) {
-                        canCastleLeft = false;
-                        break;
-                    }
-                }
-
-                if (canCastleLeft) {
-                    uint8 moveFlags = Move::FirstMoveFlag | Move::KingMoveFlag;
-                    movesList.emplace_back(from, castleLeft, moveFlags, Move::CastleLeft);
-                }
-            }
+    Bitboard checkers = attackersTo(kingSquare, pieces()) & pieces(!forSide);
+    Bitboard pinned   = pinnedPieces(forSide, kingSquare);
 
-            if (squares[rookRight].isRook() && !squares[rookRight].moved() ) {
-                bool canCastleRight= true;
-                for (Coord path = from.nextFile(); path != rookRight; path = path.nextFile() ) {
-                    if (isOccupied(path)) {
-                        canCastleRight = false;
-                        break;
-                    }
-                }
-
-                for (Coord path = from; path != castleRight; path = path.nextFile() ) {
-                    if (isSquareAttacked(path, !piece.color() )) {
-                        canCastleRight = false;
-                        break;
-                    }
-                }
-
-                if (canCastleRight) {
-                    uint8 moveFlags = Move::FirstMoveFlag | Move::KingMoveFlag;
-                    movesList.emplace_back(from, castleRight, moveFlags, Move::CastleRight );
-                }
-            }
-        }
+    if (checkers) {
+        generateEvasions(forSide, kingSquare, checkers, pinned, movesList);
+    } else {
+        generatePieceMoves(forSide, kingSquare, pieces(!forSide), pinned, movesList);
+        generatePawnMoves(forSide, kingSquare, ~pieces(forSide), pinned, movesList, true);
+        generateKingMoves(forSide, kingSquare, pieces(!forSide), movesList);
     }
+}
 
-    if (piece.isKnight() ) {
-        /* Knight's offsets clockwise */
-        static const sint8 knightOffsets[8][2] = { {+1,+2}, {+2,+1}, {+2,-1}, {+1,-2}, {-1,-2}, {-2,-1}, {-2,+1}, {-1,+2} };
+/* Swap algorithm: both sides alternately recapture on the target square with
+ * their least valuable attacker, each side may stop when going on would lose.
+ * Sliders behind the capturing pieces join in as the occupancy shrinks.
+ * Pins are ignored. */
+Value Board::see(Move move) const
+{
+    using namespace Bitboards;
+    constexpr Value KingValue = 10000;   // capturing into a defended square is never good
+
+    auto value = [](Piece::Type type) {
+        return type == Piece::King ? KingValue : Evaluate::PieceValue[type];
+    };
+
+    Coord from = move.origin();
+    Coord to   = move.target();
+    Piece::Type attacker = squares[from].type();
+
+    Value gain[32];
+    gain[0] = (move.type() == Move::EnPassant && (move.flags() & Move::PawnMoveFlag))
+            ? Evaluate::PieceValue[Piece::Pawn] : value(squares[to].type());
+    if (move.isPromotion()) {
+        Piece::Type promoted = move.type() == Move::PromoteToQueen  ? Piece::Queen
+                             : move.type() == Move::PromoteToKnight ? Piece::Knight
+                             : move.type() == Move::PromoteToRook   ? Piece::Rook : Piece::Bishop;
+        gain[0] += value(promoted) - value(Piece::Pawn);
+        attacker = promoted;
+    }
 
-        for (size_t i=0; i < 8; ++i) {
-            to = Coord( from.file() + knightOffsets[i][0], from.rank() + knightOffsets[i][1]);
-            if (to.isValid() && !(isOccupied(to) && piece.sameColor(squares[to]) ))
-                movesList.emplace_back(from, to, !piece.moved(), isOccupied(to) );
-        }
+    Bitboard occupied = pieces() ^ squareBB(from);
+    if (move.type() == Move::EnPassant && (move.flags() & Move::PawnMoveFlag))
+        occupied ^= squareBB(Coord(sint8(to.rank() == 5 ? to - 8 : to + 8)));
+
+    const Bitboard diagonalSliders = pieces(Piece::Bishop) | pieces(Piece::Queen);
+    const Bitboard straightSliders = pieces(Piece::Rook)   | pieces(Piece::Queen);
+
+    Bitboard attackers = attackersTo(to, occupied) & occupied;
+    Piece::Color side = !squares[from].color();
+
+    int depth = 0;
+    while (depth < 31) {
+        Bitboard sideAttackers = attackers & pieces(side);
+        if (!sideAttackers)
+            break;
+
+        // the piece standing on the square is captured next
+        ++depth;
+        gain[depth] = value(attacker) - gain[depth-1];
+        if (std::max(-gain[depth-1], gain[depth]) < 0)
+            break;  // neither side can improve by going on
+
+        int type = Piece::Pawn;
+        while (!(sideAttackers & pieces(Piece::Type(type))))
+            ++type;
+        attacker = Piece::Type(type);
+
+        occupied ^= squareBB(lsb(sideAttackers & pieces(attacker)));
+        attackers |= (bishopAttacks(to, occupied) & diagonalSliders)
+                   | (rookAttacks(to, occupied) & straightSliders);
+        attackers &= occupied;
+        side = !side;
     }
 
-    if (piece.isBishop() || piece.isQueen() ) {
-        for(int direction=NorthEast; direction < DirectionMax; direction += Rotate_90_Degree) {
+    while (depth > 0) {
+        gain[depth-1] = -std::max(-gain[depth-1], gain[depth]);
+        --depth;
+    }
+    return gain[0];
+}
 
-            to = from;
-            while(to.isValid() ) {
+/* in check: king steps, and against a single checker also captures and blocks */
+void Board::generateEvasions(Piece::Color side, Coord kingSquare, Bitboard checkers, Bitboard pinned, MoveList &movesList) const
+{
+    generateKingMoves(side, kingSquare, ~pieces(side), movesList);
 
-                switch (direction) {
-                case NorthEast: to = to.nextDiagMain(); break;
-                case SouthWest: to = to.prevDiagMain(); break;
-                case NorthWest: to = to.nextDiagAnti(); break;
-                case SouthEast: to = to.prevDiagAnti(); break;
-                default: ; // honestly it really should not happen
-                }
+    if (Bitboards::moreThanOne(checkers))
+        return;  // double check, only the king can move
 
-                if (!to.isValid() )
-                    break;
+    Coord checker = Bitboards::lsb(checkers);
+    Bitboard target = Bitboards::between(kingSquare, checker) | checkers;
 
-                if (!isOccupied(to) ) {
-                    movesList.emplace_back(from, to, !piece.moved(), false);
-                } else {
-                    if ( !piece.sameColor(squares[to]) )
-                        movesList.emplace_back(from, to, !piece.moved(), true);
-                    break;
-                }
+    generatePieceMoves(side, kingSquare, target, pinned, movesList);
+    generatePawnMoves(side, kingSquare, target, pinned, movesList);
+}
 
-            }
+/* Knight, Bishop, Rook and Queen moves landing on target */
+void Board::generatePieceMoves(Piece::Color side, Coord kingSquare, Bitboard target, Bitboard pinned, MoveList &movesList) const
+{
+    using namespace Bitboards;
+    Bitboard occupied = pieces();
+    Bitboard enemies  = pieces(!side);
+    Bitboard movers   = pieces(side) & ~pieces(Piece::Pawn) & ~pieces(Piece::King);
+
+    while (movers) {
+        Coord from = popLsb(movers);
+        Piece piece = squares[from];
+
+        Bitboard targets = attacks(piece.type(), from, occupied) & target;
+        if (pinned & squareBB(from))
+            targets &= line(kingSquare, from);  // a pinned piece may only slide along the pin
+
+        while (targets) {
+            Coord to = popLsb(targets);
+            movesList.emplace_back(from, to, !piece.moved(), bool(enemies & squareBB(to)) );
         }
     }
+}
 
-    if (piece.isRook() || piece.isQueen() ) {
-        for(int direction=North; direction < DirectionMax; direction += Rotate_90_Degree) {
+static inline void addPawnMove(MoveList &movesList, Coord from, Coord to, bool firstMove, bool capture)
+{
+    // Handle Promotion
+    if (to.rank() == 7 || to.rank() == 0) {
+        uint8 moveFlags = Move::PawnMoveFlag;
+        if (firstMove) moveFlags |= Move::FirstMoveFlag;
+        if (capture)   moveFlags |= Move::CaptureFlag;
+        movesList.emplace_back(from, to, moveFlags, Move::PromoteToQueen);
+        movesList.emplace_back(from, to, moveFlags, Move::PromoteToKnight);
+        movesList.emplace_back(from, to, moveFlags, Move::PromoteToRook);
+        movesList.emplace_back(from, to, moveFlags, Move::PromoteToBishop);
+    } else {
+        movesList.emplace_back(from, to, firstMove, capture);
+    }
+}
 
-            to = from;
-            while(to.isValid() ) {
+/* with capturesOnly the only pushes generated are promotions */
+void Board::generatePawnMoves(Piece::Color side, Coord kingSquare, Bitboard target, Bitboard pinned, MoveList &movesList, bool capturesOnly) const
+{
+    using namespace Bitboards;
+    const Bitboard empty   = ~pieces();
+    const Bitboard enemies = pieces(!side);
+    const int push = (side == Piece::White ? 8 : -8);
 
-                switch (direction) {
-                case East:      to = to.nextFile(); break;
-                case West:      to = to.prevFile(); break;
-                case North:     to = to.nextRank(); break;
-                case South:     to = to.prevRank(); break;
-                default: ; // honestly it really should not happen
-                }
+    Bitboard pawns = pieces(Piece::Pawn, side);
+    while (pawns) {
+        Coord from = popLsb(pawns);
+        bool firstMove = !squares[from].moved();
 
-                if (!to.isValid() )
-                    break;
+        Bitboard allowed = target;
+        if (pinned & squareBB(from))
+            allowed &= line(kingSquare, from);
 
-                if (!isOccupied(to) ) {
-                    movesList.emplace_back(from, to, !piece.moved(), false);
-                } else {
-                    if ( !piece.sameColor(squares[to]) )
-                        movesList.emplace_back(from, to, !piece.moved(), true);
-                    break;
-                }
+        /* Pawn Move */
+        Coord to = Coord(sint8(from + push));
+        if (to.isValid() && (empty & squareBB(to)) && (!capturesOnly || (squareBB(to) & (Rank1 | Rank8))) ) {
+            if (allowed & squareBB(to))
+                addPawnMove(movesList, from, to, firstMove, false);
 
+            /* Pawn double move */
+            if (firstMove && !capturesOnly) {
+                to = Coord(sint8(to + push));
+                if (to.isValid() && (empty & allowed & squareBB(to)) )
+                    movesList.emplace_back(from, to, Move::FirstMoveFlag | Move::PawnMoveFlag, Move::DoubleStep);
             }
         }
-    }
-
-
-    /* Remove all moves that put our king under attack. */
-    for (size_t i=0; i < movesList.size(); ++i) {
 
-        Move move = movesList[i];
-        make(move);
+        /* Pawn Takes */
+        Bitboard captures = pawnAttacks[side][from] & enemies & allowed;
+        while (captures)
+            addPawnMove(movesList, from, popLsb(captures), firstMove, true);
+    }
 
-        if (isKingAttacked(piece.color() )) {
-            movesList[i--] = movesList.back();  // delete i from movesList
-            movesList.pop_back();
-        }
+    /* En Passant, rare enough to verify by recomputing the attackers on the king */
+    Coord enPassant = enPassantSquare();
+    if (side != m_sideToMove || !enPassant.isValid())
+        return;
 
-        unmake();
+    Coord capturedPawn = Coord(sint8(enPassant - push));
+    Bitboard candidates = pawnAttacks[!side][enPassant] & pieces(Piece::Pawn, side);
+    while (candidates) {
+        Coord from = popLsb(candidates);
+        Bitboard occupied = (pieces() ^ squareBB(from) ^ squareBB(capturedPawn)) | squareBB(enPassant);
+        if (attackersTo(kingSquare, occupied) & enemies & ~squareBB(capturedPawn))
+            continue;
+
+        uint8 moveFlags = Move::PawnMoveFlag | Move::CaptureFlag;
+        if (!squares[from].moved())
+            moveFlags |= Move::FirstMoveFlag;
+        movesList.emplace_back(from, enPassant, moveFlags, Move::EnPassant);
     }
+}
 
-    return movesList;
+void Board::generateKingMoves(Piece::Color side, Coord kingSquare, Bitboard target, MoveList &movesList) const
+{
+    using namespace Bitboards;
+    Piece king = squares[kingSquare];
+    Bitboard enemies  = pieces(!side);
+    Bitboard occupied = pieces() ^ squareBB(kingSquare);  // sliders must see through the moving king
+    Bitboard targets  = kingAttacks[kingSquare] & ~pieces(side) & target;
+
+    while (targets) {
+        Coord to = popLsb(targets);
+        if (!(attackersTo(to, occupied) & enemies))
+            movesList.emplace_back(kingSquare, to, !king.moved(), bool(enemies & squareBB(to)) );
+    }
 }
 
-Vector<Move> Board::possibleMoves(Piece::Color forSide)
+/* Castling, the caller guarantees that the king is not in check */
+void Board::generateCastling(Piece::Color side, Coord kingSquare, MoveList &movesList) const
 {
-    Vector<Move> movesList;
+    using namespace Bitboards;
+    if (squares[kingSquare].moved())
+        return;
+
+    for (int castleSide = 0; castleSide < 2; ++castleSide) {
+        Coord rookSquare   = Coord(castleSide == 0 ? 0 : 7, kingSquare.rank() );
+        Coord castleSquare = Coord(castleSide == 0 ? 2 : 6, kingSquare.rank() );
+        Piece rook = squares[rookSquare];
 
-    for ( int index = 0; index < 64; ++index) {
-        if (isOccupied(index) && squares[index].color() == forSide) {
-            Vector<Move> pieceMoves = possibleMoves(Coord(index) );
-            movesList.insert(movesList.end(), pieceMoves.begin(), pieceMoves.end() );
+        if (!rook.isRook() || rook.moved() || rook.color() != side)
+            continue;
+
+        if (between(kingSquare, rookSquare) & pieces())
+            continue;
+
+        bool canCastle = true;
+        Bitboard path = between(kingSquare, castleSquare) | squareBB(castleSquare);
+        while (path) {
+            if (isSquareAttacked(popLsb(path), !side)) {
+                canCastle = false;
+                break;
+            }
+        }
+
+        if (canCastle) {
+            uint8 moveFlags = Move::FirstMoveFlag | Move::KingMoveFlag;
+            movesList.emplace_back(kingSquare, castleSquare, moveFlags, castleSide == 0 ? Move::CastleLeft : Move::CastleRight);
         }
     }
-    return movesList;
 }
 
 void Board::make(Move move)
 {
     Piece piece = squares[move.origin()];
 
+    bool touchesCastling = (Bitboards::squareBB(move.origin()) | Bitboards::squareBB(move.target())) & Zobrist::CastlingSquares;
+    int castlingBefore = touchesCastling ? castlingRights() : 0;
+    previousStates.push_back(StateInfo{m_key, m_halfmoveClock, m_pliesFromNull});
+    m_key ^= enPassantKey();
+
+    bool irreversible = (move.flags() & (Move::CaptureFlag | Move::PawnMoveFlag));
+    m_halfmoveClock = irreversible ? 0 : m_halfmoveClock + 1;
+    ++m_pliesFromNull;
+
     if (move.flags() & Move::FirstMoveFlag)
         piece.setMoved(true);
 
@@ -435,6 +629,23 @@ void Board::make(Move move)
 
     movesDone.emplace_back(move);
     m_sideToMove = !piece.color();
+
+    m_key ^= Zobrist::side ^ enPassantKey();
+    if (touchesCastling)
+        m_key ^= Zobrist::castling[castlingBefore] ^ Zobrist::castling[castlingRights()];
+    verifyState();
+}
+
+void Board::makeNullMove()
+{
+    previousStates.push_back(StateInfo{m_key, m_halfmoveClock, m_pliesFromNull});
+    ++m_halfmoveClock;
+    m_pliesFromNull = 0;
+    m_key ^= enPassantKey();
+    movesDone.emplace_back(Move());
+    m_sideToMove = !m_sideToMove;
+    m_key ^= Zobrist::side ^ enPassantKey();
+    verifyState();
 }
 
 void Board::unmake()
@@ -443,9 +654,26 @@ void Board::unmake()
         return;
 
     Move move = movesDone.back();
+    m_halfmoveClock = previousStates.back().halfmoveClock;
+    m_pliesFromNull = previousStates.back().pliesFromNull;
+    previousStates.pop_back();
+
+    if (!move.isValid()) {
+        // null move
+        m_key ^= enPassantKey();
+        movesDone.pop_back();
+        m_sideToMove = !m_sideToMove;
+        m_key ^= Zobrist::side ^ enPassantKey();
+        verifyState();
+        return;
+    }
     Piece piece = squares[move.target()];
     Piece piece_trgt;
 
+    bool touchesCastling = (Bitboards::squareBB(move.origin()) | Bitboards::squareBB(move.target())) & Zobrist::CastlingSquares;
+    int castlingBefore = touchesCastling ? castlingRights() : 0;
+    m_key ^= enPassantKey();
+
     if (move.flags() & Move::CaptureFlag) {
         if (move.flags() & Move::PawnMoveFlag && move.type() == Move::EnPassant){
             Piece::Color side = squares[move.target()].color() ;
@@ -481,6 +709,11 @@ void Board::unmake()
     movesDone.pop_back();
 
     m_sideToMove = piece.color();
+
+    m_key ^= Zobrist::side ^ enPassantKey();
+    if (touchesCastling)
+        m_key ^= Zobrist::castling[castlingBefore] ^ Zobrist::castling[castlingRights()];
+    verifyState();
 }
 
 } // namespace ChessEngine
@@ -2,6 +2,10 @@
 #define BOARD_H
 
 #include "enginetypes.h"
+#include "bitboard.h"
+#include "zobrist.h"
+#include "psqt.h"
+#include "nnue.h"
 
 namespace Chess {
 
@@ -9,26 +13,89 @@ class Board
 {
 public: // !!!
     Array<Piece,64> squares;
+    Array<Bitboard,7> byType;   // indexed by Piece::Type, kept in sync with squares by setPiece()
+    Array<Bitboard,2> byColor;
+    Array<Coord,2> kingSquares; // indexed by Piece::Color, invalid while the side has no king
     Vector<Piece> capturedPieces;
     Vector<Move> movesDone;
     Piece::Color m_sideToMove;
+    Coord m_fenEnPassant;       // en passant square of the initial position, used until the first move
+    Key m_key;                  // Zobrist key, updated incrementally by setPiece(), make() and unmake()
+    Key m_pawnKey;              // Zobrist key of the pawns alone, for the pawn hash
+    Score m_psq;                // material and piece-square score from White's point of view, updated like the key
+    int m_phase;                // sum of Psqt::PhaseWeight, MaxPhase and above is the opening
+    Nnue::Accumulator m_accumulator;    // first layer of the network, updated by setPiece() while one is loaded
+    int m_halfmoveClock;        // plies since the last capture or pawn move, for the fifty-move rule
+    int m_pliesFromNull;        // plies since the last null move or the initial position
+
+    struct StateInfo {
+        Key key;
+        int halfmoveClock;
+        int pliesFromNull;
+    };
+    Vector<StateInfo> previousStates;   // state before each of movesDone, restored by unmake()
 
 public:
     Board() :
-        squares(), m_sideToMove(Piece::White) {}
+        squares(), byType(), byColor(), kingSquares(), m_sideToMove(Piece::White), m_fenEnPassant(), m_key(0), m_pawnKey(0),
+        m_psq(), m_phase(0), m_accumulator(), m_halfmoveClock(0), m_pliesFromNull(0) {}
 
     static Board fromFEN(std::string fenRecord);
 
-    bool isSquareAttacked(Coord square, Piece::Color attackingSide);
+    bool isSquareAttacked(Coord square, Piece::Color attackingSide) const;
 
-    bool isKingAttacked(Piece::Color side);
+    bool isKingAttacked(Piece::Color side) const;
 
-    Vector<Move> possibleMoves(const Coord from) ;
+    Bitboard attackersTo(Coord square, Bitboard occupied) const;
 
-    Vector<Move> possibleMoves(Piece::Color forSide) ;
+    Bitboard pinnedPieces(Piece::Color side, Coord kingSquare) const;
+
+    Coord enPassantSquare() const;
+
+    int castlingRights() const;
+
+    // key of the position computed from scratch, for initialization and verification
+    Key computeKey() const;
+    Key computePawnKey() const;
+
+    // material and piece-square score computed from scratch, for verification
+    void computePsq(Score &psq, int &phase) const;
+
+    // network accumulator computed from scratch, for positions set up before the network was loaded
+    void computeAccumulator(Nnue::Accumulator &accumulator) const;
+    void refreshAccumulator();
+
+    // true if the position occurred before since the last irreversible move
+    bool isRepetition() const;
+
+    // repetition or fifty-move rule, a mate on the hundredth ply still counts as mate
+    bool isDraw() const;
+
+    Vector<Move> possibleMoves(const Coord from) const;
+
+    Vector<Move> possibleMoves(Piece::Color forSide) const;
+
+    // append the legal moves into a caller-owned list, no heap allocation
+    void possibleMoves(const Coord from, MoveList &movesList) const;
+
+    void possibleMoves(Piece::Color forSide, MoveList &movesList) const;
+
+    // legal captures and promotions, all evasions when in check (for the quiescence search)
+    void possibleCaptures(Piece::Color forSide, MoveList &movesList) const;
+
+    // static exchange evaluation: material balance in centipawns of the capture sequence on the target square
+    Value see(Move move) const;
 
     void make(Move move);
 
+    // passes the turn, recorded as an invalid move so unmake() takes it back like any other
+    void makeNullMove();
+
+    // true if the last move made was a null move, never in a position set up from scratch
+    inline bool isAfterNullMove() const {
+        return !movesDone.empty() && !movesDone.back().isValid();
+    }
+
     void unmake();
 
     inline bool isOccupied(Coord coord) const {
@@ -37,7 +104,34 @@ public:
 
     inline void setPiece(Coord coord, Piece piece) {
         if (coord.isValid()) {
+            Bitboard bb = Bitboards::squareBB(coord);
+            Piece old = squares[coord];
+            if (!old.isEmpty()) {
+                byType[old.type()]   ^= bb;
+                byColor[old.color()] ^= bb;
+                if (old.isKing() && kingSquares[old.color()] == coord)
+                    kingSquares[old.color()] = Coord();
+            }
+            if (!piece.isEmpty()) {
+                byType[piece.type()]   ^= bb;
+                byColor[piece.color()] ^= bb;
+                if (piece.isKing())
+                    kingSquares[piece.color()] = coord;
+            }
             squares[coord] = piece;
+            m_key ^= Zobrist::piece(old, coord) ^ Zobrist::piece(piece, coord);
+            if (old.isPawn())
+                m_pawnKey ^= Zobrist::piece(old, coord);
+            if (piece.isPawn())
+                m_pawnKey ^= Zobrist::piece(piece, coord);
+            m_psq += Psqt::piece(piece, coord) - Psqt::piece(old, coord);
+            m_phase += Psqt::PhaseWeight[piece.type()] - Psqt::PhaseWeight[old.type()];
+            if (Nnue::isLoaded()) {
+                if (!old.isEmpty())
+                    Nnue::removePiece(m_accumulator, old, coord);
+                if (!piece.isEmpty())
+                    Nnue::addPiece(m_accumulator, piece, coord);
+            }
         } else {
             qDebug() << "Board::setPiece() Invalid Coord: should never happen!";
         }
@@ -51,9 +145,64 @@ public:
         return m_sideToMove;
     }
 
-    inline Piece & operator[](Coord square) {
+    inline Coord kingSquare(Piece::Color color) const {
+        return kingSquares[color];
+    }
+
+    inline Key key() const {
+        return m_key;
+    }
+
+    inline Key pawnKey() const {
+        return m_pawnKey;
+    }
+
+    inline Score psq() const {
+        return m_psq;
+    }
+
+    inline int phase() const {
+        return m_phase;
+    }
+
+    inline const Nnue::Accumulator & accumulator() const {
+        return m_accumulator;
+    }
+
+    inline int halfmoveClock() const {
+        return m_halfmoveClock;
+    }
+
+    inline Bitboard pieces() const {
+        return byColor[Piece::White] | byColor[Piece::Black];
+    }
+
+    inline Bitboard pieces(Piece::Color color) const {
+        return byColor[color];
+    }
+
+    inline Bitboard pieces(Piece::Type type) const {
+        return byType[type];
+    }
+
+    inline Bitboard pieces(Piece::Type type, Piece::Color color) const {
+        return byType[type] & byColor[color];
+    }
+
+    // read-only, writes have to go through setPiece() to keep the bitboards in sync
+    inline Piece operator[](Coord square) const {
         return squares[square];
     }
+
+private:
+    Key enPassantKey() const;
+    void verifyState() const;
+
+    void generateEvasions(Piece::Color side, Coord kingSquare, Bitboard checkers, Bitboard pinned, MoveList &movesList) const;
+    void generatePieceMoves(Piece::Color side, Coord kingSquare, Bitboard target, Bitboard pinned, MoveList &movesList) const;
+    void generatePawnMoves(Piece::Color side, Coord kingSquare, Bitboard target, Bitboard pinned, MoveList &movesList, bool capturesOnly = false) const;
+    void generateKingMoves(Piece::Color side, Coord kingSquare, Bitboard target, MoveList &movesList) const;
+    void generateCastling(Piece::Color side, Coord kingSquare, MoveList &movesList) const;
 };
 
 } // !namespace Chess
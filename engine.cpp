@@ -1,19 +1,36 @@
 #include "engine.h"
 
-#include <QCoreApplication>
-#include <chrono>
-
 namespace Chess {
 
 Engine::Engine(QObject *parent) :
-    QObject(parent)
+    QObject(parent),
+    moveTime(2000),
+    ponder(true)
 {
+    qRegisterMetaType<Chess::SearchInfo>("Chess::SearchInfo");
+    qRegisterMetaType<Chess::SearchResult>("Chess::SearchResult");
+
+    // the search reports from its own thread, the move is played in ours
+    connect(this, SIGNAL(searchFinished(Chess::SearchResult)),
+            this, SLOT(onSearchFinished(Chess::SearchResult)), Qt::QueuedConnection);
+
+    qDebug() << "hash table on large pages:" << minimax.hashUsesHugePages();
 }
 
+Engine::~Engine()
+{
+    minimax.stop();
+}
 
 void Engine::userMoved(Move userMove)
 {
-    Vector<Move> possibleMoves = board.possibleMoves(board.side());
+    if (isThinking()) {
+        qDebug() << "Wait for the engine move";
+        return;
+    }
+
+    MoveList possibleMoves;
+    board.possibleMoves(board.side(), possibleMoves);
 
     Move validMove;
     for (Move move : possibleMoves) {
@@ -25,6 +42,22 @@ void Engine::userMoved(Move userMove)
     if ( validMove.isValid() ) {
         qDebug() << QString("---Ply #%1---").arg(board.movesDone.size());
         qDebug() << "My Move:" << userMove.origin().file() << userMove.origin().rank() << "to" << userMove.target().file() << userMove.target().rank();
+
+        if (isPondering()) {
+            bool ponderHit = (validMove == ponderMove);
+            ponderMove = Move();
+            if (ponderHit) {
+                // the running search becomes the real one, its result arrives through onSearchFinished()
+                qDebug() << "Ponder hit";
+                makeMove(validMove);
+                minimax.ponderHit();
+                return;
+            }
+            // ponder miss: the stale result is dropped by onSearchFinished(), the warmed tables stay
+            searchHandle->stop();
+            searchHandle->wait();
+            searchHandle.reset();
+        }
         makeMove(validMove);
     } else if (possibleMoves.size() > 0){
         qDebug() << "Invalid move:" << userMove.origin().file() << userMove.origin().rank() << "to" << userMove.target().file() << userMove.target().rank();
@@ -36,37 +69,69 @@ void Engine::userMoved(Move userMove)
         qDebug() << "Game Over";
     }
 
-    Move minimaxMove;
+    startThinking();
+}
 
-    //do  {
+void Engine::startThinking()
+{
     qDebug() << QString("---Ply #%1---").arg(board.movesDone.size());
-    QCoreApplication::processEvents();
     qDebug() << "AI thinks...";
     SearchRequest request;
     request.board = board;
-    request.depth = 5;
-    request.movesFilter = Vector<Move>();
-    auto start_time = std::chrono::high_resolution_clock::now();
-    SearchResult result = minimax.search(request);
-    auto stop_time = std::chrono::high_resolution_clock::now();
-    int ms = std::chrono::duration_cast<std::chrono::milliseconds>(stop_time - start_time).count();
-    ms = std::max(ms, 1); // prevent the good old divide by 0 problem :)
-    real bestMoveScore = result.score;
-    minimaxMove = result.moves.size() > 0 ? result.moves[0] : Move();
-    int minimaxMoveCnt = result.moveCnt;
-
-    qDebug() << " score:" << bestMoveScore;
-    qDebug() << " nodes analized:" << minimaxMoveCnt <<  ms << "ms"
-             << "nodes/s =" << (minimaxMoveCnt / ms * 1000);
+    request.movetime = moveTime;
+
+    // both callbacks run in the search thread, queued signals hand the data over
+    searchHandle = minimax.start(request,
+        [this](const SearchResult &result) { emit searchFinished(result); },
+        [this](const SearchInfo &info) { emit searchInfo(info); });
+}
+
+void Engine::startPondering(Move expectedMove)
+{
+    SearchRequest request;
+    request.board = board;
+    request.board.make(expectedMove);
+    request.movetime = moveTime;
+    request.ponder = true;
+
+    ponderMove = expectedMove;
+    searchHandle = minimax.start(request,
+        [this](const SearchResult &result) { emit searchFinished(result); },
+        [this](const SearchInfo &info) { emit searchInfo(info); });
+}
+
+void Engine::stopThinking()
+{
+    if (isThinking())
+        searchHandle->stop();
+}
+
+void Engine::onSearchFinished(SearchResult result)
+{
+    // the result of a ponder miss, the board went on without it
+    if (result.request.board.key() != board.key())
+        return;
+
+    searchHandle.reset();
+
+    Move minimaxMove = result.moves.size() > 0 ? result.moves[0] : Move();
+    qDebug() << " score:" << result.score << "depth:" << result.depth;
+    qDebug() << " nodes analized:" << result.moveCnt;
+    qDebug() << " eval cache hits:" << result.evalStats.evalHits
+             << "of" << result.evalStats.evalHits + result.evalStats.evalMisses
+             << "pawn hash hits:" << result.evalStats.pawnHits
+             << "of" << result.evalStats.pawnHits + result.evalStats.pawnMisses;
+    qDebug() << " lazy evaluations:" << result.evalStats.lazyExits;
+    qDebug() << " hash full:" << result.hashfull << "permille";
     qDebug() << "AI Move:" << minimaxMove;
-    QCoreApplication::processEvents();
 
     if (minimaxMove.isValid()) {
         makeMove(minimaxMove);
+        if (ponder && result.moves.size() > 1)
+            startPondering(result.moves[1]);
     } else {
         qDebug() << "Game Over";
     }
-    //} while (minimaxMove.isValid());
 }
 
 void Engine::makeMove(Move move)
@@ -75,14 +140,23 @@ void Engine::makeMove(Move move)
     emit boardChanged(board);
 }
 
+void Engine::cancelSearch()
+{
+    minimax.stop();
+    searchHandle.reset();
+    ponderMove = Move();
+}
+
 void Engine::setPiece(Coord coord, Piece piece)
 {
+    cancelSearch();
     board.setPiece(coord, piece);
     emit boardChanged(board);
 }
 
 void Engine::setBoard(Board newBoard)
 {
+    cancelSearch();
     this->board = newBoard;
     emit boardChanged(board);
 }
@@ -5,6 +5,8 @@
 #include "board.h"
 #include "search.h"
 
+#include <memory>
+
 
 namespace Chess{
 
@@ -15,9 +17,24 @@ class Engine : public QObject
 public:
     Board board;
     Search minimax;
+    int moveTime;   // ms per engine move
+    bool ponder;    // think on the expected reply while the user moves
+
+private:
+    std::shared_ptr<SearchHandle> searchHandle;    // of the running search, null when idle
+    Move ponderMove;    // expected user move while pondering
 
 public:
     explicit Engine(QObject *parent = 0);
+    ~Engine();
+
+    bool isThinking() const {
+        return searchHandle != nullptr && !isPondering();
+    }
+
+    bool isPondering() const {
+        return ponderMove.isValid();
+    }
 
 public slots:
     void userMoved(Chess::Move userMove);
@@ -25,11 +42,31 @@ public slots:
     void setPiece(Chess::Coord coord, Chess::Piece piece);
     void setBoard(Board newBoard);
 
+    // the engine plays the best move found so far
+    void stopThinking();
+
 signals:
     void boardChanged(Chess::Board board);
 
+    // progress of the running search, after each completed iteration
+    void searchInfo(Chess::SearchInfo info);
+
+    // emitted from the search thread, queued to the engine's thread
+    void searchFinished(Chess::SearchResult result);
+
+private slots:
+    void onSearchFinished(Chess::SearchResult result);
+
+private:
+    void startThinking();
+    void startPondering(Move expectedMove);
+    void cancelSearch();
+
 };
 
 } // !namespace Chess
 
+Q_DECLARE_METATYPE(Chess::SearchInfo)
+Q_DECLARE_METATYPE(Chess::SearchResult)
+
 #endif // ENGINE_H
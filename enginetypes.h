@@ -5,6 +5,7 @@
 #include <vector>
 #include <cstdint>
 #include <algorithm>
+#include <utility>
 
 #include <QDebug>
 
@@ -14,7 +15,14 @@ using sint8  = std::int8_t;
 using uint8  = std::uint8_t;
 using sint16 = std::int16_t;
 using uint16 = std::uint16_t;
+using uint32 = std::uint32_t;
 using real   = float;
+using Value  = int;             // centipawns
+
+constexpr int   MaxPly    = 128;
+constexpr Value MateScore = 32000;              // mate at the root, one less per ply
+constexpr Value MateBound = MateScore - MaxPly; // scores beyond are mate scores
+constexpr Value MaxEval   = MateBound - 1;      // bound of static evaluations, they never look like mates
 
 template <typename T> using Vector = std::vector<T, std::allocator<T>>;
 template <typename T, std::size_t N> using Array = std::array<T, N>;
@@ -191,6 +199,15 @@ public:
                     || pieceSpecific == CastleLeft);
     }
 
+    // 32 bit representation, e.g. for storing moves in hash tables
+    constexpr uint32 pack() const {
+        return uint32(uint8(orig)) | uint32(uint8(trgt)) << 8 | uint32(moveFlags) << 16 | uint32(pieceSpecific) << 24;
+    }
+
+    static constexpr Move unpack(uint32 packed) {
+        return Move(Coord(sint8(packed & 0xFF)), Coord(sint8(packed >> 8 & 0xFF)), uint8(packed >> 16 & 0xFF), SpecialMove(packed >> 24));
+    }
+
     constexpr bool sameVector(Move other) const  {
         return orig == other.orig && trgt == other.trgt;
     }
@@ -200,6 +217,46 @@ public:
     }
 }; // !class Move
 
+/* Fixed-capacity move container living on the stack.
+ * 256 is above the maximum number of legal moves in any chess position,
+ * so the generators never check for overflow. */
+class MoveList {
+public:
+    static constexpr std::size_t Capacity = 256;
+
+private:
+    union {
+        Move moves[Capacity];   // left uninitialized, only [0, count) is valid
+    };
+    std::size_t count;
+
+public:
+    MoveList()
+        : count(0) {}
+
+    template <typename... Args>
+    inline void emplace_back(Args&&... args) {
+        moves[count++] = Move(std::forward<Args>(args)...);
+    }
+
+    inline void push_back(Move move) { moves[count++] = move; }
+    inline void pop_back()           { --count; }
+    inline void clear()              { count = 0; }
+    inline void resize(std::size_t size) { count = size; }
+
+    inline std::size_t size() const { return count; }
+    inline bool empty() const       { return count == 0; }
+
+    inline Move & back()             { return moves[count-1]; }
+    inline Move & operator[](std::size_t i)       { return moves[i]; }
+    inline Move   operator[](std::size_t i) const { return moves[i]; }
+
+    inline Move * begin()             { return moves; }
+    inline Move * end()               { return moves + count; }
+    inline const Move * begin() const { return moves; }
+    inline const Move * end() const   { return moves + count; }
+}; // !class MoveList
+
 class Piece {
 
     uint8 flags;
@@ -291,6 +348,42 @@ public:
 // inverts the Piece::Color color
 constexpr Piece::Color operator!(Piece::Color color) {return Piece::Color(color == Piece::White ? Piece::Black : Piece::White);}
 
+/* A middlegame and an endgame value packed into one 32 bit word, the endgame
+ * half in the upper 16 bits. Both halves are added and subtracted with a
+ * single integer operation, as long as each stays within 16 bits. */
+class Score {
+
+    std::int32_t packed;
+
+    struct Packed {};
+    constexpr Score(std::int32_t value, Packed)
+        : packed(value) {}
+
+public:
+    constexpr Score()
+        : packed(0) {}
+
+    constexpr Score(int mg, int eg)
+        : packed(std::int32_t(uint32(eg) << 16) + mg) {}
+
+    constexpr Value mg() const {
+        return sint16(uint16(uint32(packed)));
+    }
+
+    // the middlegame half borrows from the upper half when negative, rounding undoes it
+    constexpr Value eg() const {
+        return sint16(uint16((uint32(packed) + 0x8000) >> 16));
+    }
+
+    constexpr Score operator+(Score other) const { return Score(packed + other.packed, Packed()); }
+    constexpr Score operator-(Score other) const { return Score(packed - other.packed, Packed()); }
+    constexpr Score operator-() const { return Score(-packed, Packed()); }
+    constexpr bool operator==(Score other) const { return packed == other.packed; }
+
+    inline Score& operator+=(Score other) { packed += other.packed; return *this; }
+    inline Score& operator-=(Score other) { packed -= other.packed; return *this; }
+}; // !class Score
+
 // for debugging
 inline QDebug operator<< (QDebug d, const Coord coord) {
     d.nospace() << "(";
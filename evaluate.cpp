@@ -2,24 +2,209 @@
 
 namespace Chess {
 
-real Evaluate::position(const Board &board)
+namespace {
+
+using namespace Bitboards;
+
+constexpr Score Doubled  = Score(-10, -25);    // per pawn behind another one of its color
+constexpr Score Isolated = Score(-10, -15);
+constexpr Score Backward = Score( -8, -10);
+
+// by rank from the pawn's own side
+constexpr Score Passed[8] = {
+    Score(0, 0), Score(5, 10), Score(5, 15), Score(10, 25),
+    Score(25, 45), Score(40, 75), Score(60, 110), Score(0, 0)
+};
+
+// own pawns one and two ranks in front of the king, on its file and the adjacent ones
+constexpr Score ShelterNear = Score(12, 0);
+constexpr Score ShelterFar  = Score( 6, 0);
+
+inline Bitboard adjacentFiles(Coord square) {
+    return ((fileBB(square) << 1) & ~FileA) | ((fileBB(square) >> 1) & ~FileH);
+}
+
+// ranks strictly in front of square, as seen by color
+inline Bitboard forwardRanks(Piece::Color color, Coord square) {
+    return color == Piece::White ? ~Bitboard(0) << 8 << (8 * square.rank())
+                                 : (Bitboard(1) << (8 * square.rank())) - 1;
+}
+
+inline Bitboard shift(Piece::Color color, Bitboard b) {
+    return color == Piece::White ? b << 8 : b >> 8;
+}
+
+inline Bitboard pawnAttackSpan(Piece::Color color, Bitboard pawns) {
+    Bitboard spanned = shift(color, pawns);
+    return ((spanned << 1) & ~FileA) | ((spanned >> 1) & ~FileH);
+}
+
+Score evaluatePawns(const Board &board, Piece::Color color, Bitboard &passed) {
+    const Bitboard ours   = board.pieces(Piece::Pawn, color);
+    const Bitboard theirs = board.pieces(Piece::Pawn, !color);
+    const Bitboard theirAttacks = pawnAttackSpan(!color, theirs);
+
+    Score score;
+    passed = 0;
+    Bitboard pawns = ours;
+    while (pawns) {
+        Coord square = popLsb(pawns);
+        Bitboard front = forwardRanks(color, square);
+        Bitboard neighbours = ours & adjacentFiles(square);
+
+        if (ours & front & fileBB(square))
+            score += Doubled;
+
+        if (!neighbours) {
+            score += Isolated;
+        } else if (!(neighbours & ~front) && (theirAttacks & shift(color, squareBB(square)))) {
+            // no neighbour level or behind to support the advance, and the stop square is guarded
+            score += Backward;
+        }
+
+        if (!(theirs & front & (fileBB(square) | adjacentFiles(square))) && !(ours & front & fileBB(square))) {
+            passed |= squareBB(square);
+            int rank = (color == Piece::White) ? square.rank() : 7 - square.rank();
+            score += Passed[rank];
+        }
+    }
+    return score;
+}
+
+Score evaluateShelter(const Board &board, Piece::Color color) {
+    Coord king = board.kingSquare(color);
+    if (!king.isValid())
+        return Score();
+
+    Bitboard files = fileBB(king) | adjacentFiles(king);
+    Bitboard near  = shift(color, rankBB(king)) & files;
+    Bitboard far   = shift(color, near);
+    Bitboard ours  = board.pieces(Piece::Pawn, color);
+
+    Score score;
+    for (int i = popCount(ours & near); i > 0; --i)
+        score += ShelterNear;
+    for (int i = popCount(ours & far); i > 0; --i)
+        score += ShelterFar;
+    return score;
+}
+
+void computePawns(const Board &board, Evaluate::PawnEntry &entry) {
+    entry.key = board.pawnKey();
+    entry.score = evaluatePawns(board, Piece::White, entry.passed[Piece::White])
+                - evaluatePawns(board, Piece::Black, entry.passed[Piece::Black]);
+    for (Piece::Color color : { Piece::White, Piece::Black }) {
+        entry.kingSquares[color] = board.kingSquare(color);
+        entry.shelter[color] = evaluateShelter(board, color);
+    }
+}
+
+inline Value taper(const Board &board, Score score) {
+    int phase = std::min(board.phase(), Psqt::MaxPhase);
+    return (score.mg() * phase + score.eg() * (Psqt::MaxPhase - phase)) / Psqt::MaxPhase;
+}
+
+/* The board keeps the middlegame and endgame piece-square scores up to date,
+ * the pawn terms are added and the sum is blended by the material left on
+ * the board. */
+Value taper(const Board &board, const Evaluate::PawnEntry &pawns) {
+    return taper(board, board.psq() + pawns.score + pawns.shelter[Piece::White] - pawns.shelter[Piece::Black]);
+}
+
+inline Value network(const Board &board) {
+    Value score = Nnue::evaluate(board.accumulator(), board.side());
+    return board.side() == Piece::White ? score : -score;
+}
+
+} // !anonymous namespace
+
+Evaluate::Stats & Evaluate::Stats::operator+=(const Stats &other)
 {
-    uint8 pieceCount[2][7] = {};
+    pawnHits   += other.pawnHits;
+    pawnMisses += other.pawnMisses;
+    evalHits   += other.evalHits;
+    evalMisses += other.evalMisses;
+    lazyExits  += other.lazyExits;
+    return *this;
+}
+
+Evaluate::Stats & Evaluate::Stats::operator-=(const Stats &other)
+{
+    pawnHits   -= other.pawnHits;
+    pawnMisses -= other.pawnMisses;
+    evalHits   -= other.evalHits;
+    evalMisses -= other.evalMisses;
+    lazyExits  -= other.lazyExits;
+    return *this;
+}
 
-    for (int i=0; i<64; ++i) {
-        Piece p = board.piece(i);
-        pieceCount[p.color()][p.type()]++;
+/* Pawns move rarely compared with the other pieces, so the entry of the
+ * current configuration is nearly always in the table already. */
+const Evaluate::PawnEntry & Evaluate::Context::pawns(const Board &board)
+{
+    PawnEntry &entry = pawnTable[board.pawnKey() & (PawnTableSize - 1)];
+    if (entry.key != board.pawnKey() || entry.kingSquares[Piece::White] == Coord()) {
+        ++stats.pawnMisses;
+        computePawns(board, entry);
+        return entry;
     }
 
-    qreal material =
-            //100.0 * (pieceCount[Piece::White][Piece::King]   - pieceCount[Piece::Black][Piece::King])
-            + 9.0 * (pieceCount[Piece::White][Piece::Queen]  - pieceCount[Piece::Black][Piece::Queen])
-            + 5.0 * (pieceCount[Piece::White][Piece::Rook]   - pieceCount[Piece::Black][Piece::Rook])
-            + 3.0 * (pieceCount[Piece::White][Piece::Bishop] - pieceCount[Piece::Black][Piece::Bishop])
-            + 3.0 * (pieceCount[Piece::White][Piece::Knight] - pieceCount[Piece::Black][Piece::Knight])
-            + 1.0 * (pieceCount[Piece::White][Piece::Pawn]   - pieceCount[Piece::Black][Piece::Pawn]);
+    ++stats.pawnHits;
+    for (Piece::Color color : { Piece::White, Piece::Black }) {
+        if (entry.kingSquares[color] != board.kingSquare(color)) {
+            entry.kingSquares[color] = board.kingSquare(color);
+            entry.shelter[color] = evaluateShelter(board, color);
+        }
+    }
+    return entry;
+}
 
-    return material;
+/* Transpositions and the re-searches of later iterations reach the same
+ * leaves again, their score is looked up instead of evaluated anew. */
+bool Evaluate::Context::probe(Key key, Value &score)
+{
+    std::uint64_t entry = evalCache[key & (EvalCacheSize - 1)];
+    if (entry && (entry ^ key) >> 16 == 0) {
+        ++stats.evalHits;
+        score = sint16(uint16(entry));
+        return true;
+    }
+    ++stats.evalMisses;
+    return false;
+}
+
+void Evaluate::Context::store(Key key, Value score)
+{
+    evalCache[key & (EvalCacheSize - 1)] = (key & ~std::uint64_t(0xFFFF)) | uint16(sint16(score));
+}
+
+// a loaded network replaces the handwritten terms, its accumulator is kept up to date like the scores
+Value Evaluate::position(const Board &board, Context &context)
+{
+    Value score;
+    if (context.probe(board.key(), score))
+        return score;
+
+    // clamped before it is cached, so the 16 bits of an entry hold it and a hit returns the same
+    score = Nnue::isLoaded() ? network(board) : taper(board, context.pawns(board));
+    score = std::max(-MaxEval, std::min(score, MaxEval));
+    context.store(board.key(), score);
+    return score;
+}
+
+/* Most leaves of a search are far outside its window, the cheap estimate
+ * usually decides them; LazyMargin says how often it can be wrong. The
+ * network has no cheap part, it is never lazy. */
+Value Evaluate::position(const Board &board, Context &context, Value alpha, Value beta, Value margin)
+{
+    if (!Nnue::isLoaded()) {
+        Value estimate = taper(board, board.psq());
+        if (estimate + margin <= alpha || estimate - margin >= beta) {
+            ++context.stats.lazyExits;
+            return estimate;
+        }
+    }
+    return position(board, context);
 }
 
 } // !namespace Chess
@@ -7,7 +7,73 @@
 namespace Chess {
 namespace Evaluate{
 
-    real position(const Board& board);
+    // exchange values in centipawns, indexed by Piece::Type, for SEE and the pruning margins
+    constexpr Value PieceValue[7] = { 0, 100, 300, 300, 500, 900, 0 };
+
+    /* Pawn structure terms of one pawn configuration. The king shelter
+     * depends on the king square as well, it is kept for the king squares
+     * it was computed for and recomputed when a king moves. */
+    struct PawnEntry {
+        Key key;
+        Score score;                // doubled, isolated, backward and passed pawns, White's point of view
+        Bitboard passed[2];         // passed pawns by color
+        Coord kingSquares[2];
+        Score shelter[2];           // pawns in front of each king, from its own side's point of view
+    };
+
+    /* Default margin of the lazy evaluation, a heuristic tuned against the
+     * exit rate and not a safe bound. The lazy estimate skips the pawn
+     * structure and the king shelter, the only terms beyond material and
+     * piece-square tables. Their real bound is far above any useful margin:
+     * a passed pawn alone is worth up to 110 in the endgame, a shelter up to
+     * 54 in the middlegame. With several advanced passed pawns the estimate
+     * can be on the wrong side of the window. A wider margin misjudges fewer positions
+     * and exits less often, SearchOptions::lazyMargin overrides it. */
+    constexpr Value LazyMargin = 350;
+
+    // counters of the tables and of the lazy evaluation, reported per search in SearchInfo and SearchResult
+    struct Stats {
+        std::uint64_t pawnHits = 0;
+        std::uint64_t pawnMisses = 0;
+        std::uint64_t evalHits = 0;
+        std::uint64_t evalMisses = 0;
+        std::uint64_t lazyExits = 0;    // windowed evaluations answered by the material and piece-square estimate
+
+        Stats & operator+=(const Stats &other);
+        Stats & operator-=(const Stats &other);
+    };
+
+    /* Evaluation state owned by one search thread, no locking needed */
+    class Context {
+    public:
+        static constexpr std::size_t PawnTableSize = 1 << 13;   // entries, a power of two
+        static constexpr std::size_t EvalCacheSize = 1 << 14;   // entries, a power of two
+
+        Context() : pawnTable(PawnTableSize), evalCache(EvalCacheSize) {}
+
+        // the entry of the board's pawn configuration, probed or computed and stored
+        const PawnEntry & pawns(const Board &board);
+
+        // the evaluation of a position seen before, false if it has to be computed;
+        // stored scores have to be within MaxEval
+        bool probe(Key key, Value &score);
+        void store(Key key, Value score);
+
+        Stats stats;
+
+    private:
+        Vector<PawnEntry> pawnTable;
+        Vector<std::uint64_t> evalCache;    // upper 48 bits of the key, the score in the lower 16
+    };
+
+    // tapered score in centipawns from White's point of view, within MaxEval; the pawn terms come from the context's table
+    Value position(const Board& board, Context &context);
+
+    /* The same for a search window [alpha, beta], from White's point of view
+     * as well: a position whose material and piece-square score is outside
+     * the window by more than margin returns that estimate without the other
+     * terms. */
+    Value position(const Board& board, Context &context, Value alpha, Value beta, Value margin = LazyMargin);
 }
 }
 
@@ -3,13 +3,21 @@
 #include <QApplication>
 #include <UI/uiboard.h>
 #include <QPixmap>
+#include <QShortcut>
 #include "engine.h"
+#include "nnue.h"
+#include <cstdlib>
+#include <cstring>
 using namespace Chess;
 
 int main(int argc, char*argv[])
 {
     QApplication app(argc, argv);
 
+    // "-nnue <file>" evaluates with a network instead of the piece-square tables
+    for (int i = 1; i + 1 < argc; ++i)
+        if (!std::strcmp(argv[i], "-nnue"))
+            Nnue::load(argv[i + 1]);
 
     UIBoard *uib = new UIBoard();
     Engine  *eng = new Engine();
@@ -17,6 +25,18 @@ int main(int argc, char*argv[])
     QObject::connect(uib, SIGNAL(userMoved(Chess::Move)), eng, SLOT(userMoved(Chess::Move)));
     QObject::connect(eng, SIGNAL(boardChanged(Chess::Board)), uib, SLOT(setBoard(Chess::Board)));
 
+    // the progress of the search goes to the window title, space makes the engine move at once
+    QObject::connect(eng, &Engine::searchInfo, uib, [uib](const SearchInfo &info) {
+        int mateIn = (MateScore - std::abs(info.score) + 1) / 2;
+        QString score = std::abs(info.score) >= MateBound
+                ? QString("mate %1").arg(info.score > 0 ? mateIn : -mateIn)
+                : QString::number(info.score / 100.0, 'f', 2);
+        uib->setWindowTitle(QString("depth %1  score %2  nodes %3  nps %4")
+                            .arg(info.depth).arg(score).arg(qulonglong(info.nodes)).arg(qulonglong(info.nps)));
+    });
+    QShortcut *moveNow = new QShortcut(QKeySequence(Qt::Key_Space), uib);
+    QObject::connect(moveNow, SIGNAL(activated()), eng, SLOT(stopThinking()));
+
     eng->setBoard(Board::fromFEN("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w"));
 
     uib->show();
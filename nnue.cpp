@@ -0,0 +1,261 @@
+#include "nnue.h"
+
+#include <fstream>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NNUE_SIMD
+#include <immintrin.h>
+#endif
+
+namespace Chess {
+namespace Nnue {
+
+bool loaded = false;
+
+namespace {
+
+alignas(64) sint16 featureWeights[Inputs][Hidden];
+alignas(64) sint16 featureBias[Hidden];
+alignas(64) sint16 outputWeights[2][Hidden];
+sint16 outputBias;
+
+// the inputs of a perspective: own pieces first, ranks flipped for Black
+inline int featureIndex(Piece::Color perspective, Piece piece, Coord square) {
+    int color = (piece.color() == perspective) ? 0 : 1;
+    int index = (perspective == Piece::White) ? int(square) : (square ^ 56);
+    return color * 384 + (piece.type() - Piece::Pawn) * 64 + index;
+}
+
+/* Kernels
+ *
+ * The accumulator wraps around like the scalar int16 arithmetic, the output
+ * layer saturates before clipping, so every kernel returns exactly what the
+ * scalar one does. Weights are 64 byte aligned, accumulators may not be. */
+
+void addScalar(sint16 *accumulator, const sint16 *weights) {
+    for (int i = 0; i < Hidden; ++i)
+        accumulator[i] = sint16(accumulator[i] + weights[i]);
+}
+
+void subScalar(sint16 *accumulator, const sint16 *weights) {
+    for (int i = 0; i < Hidden; ++i)
+        accumulator[i] = sint16(accumulator[i] - weights[i]);
+}
+
+// sum of the clipped first layer outputs times the output weights
+std::int32_t outputScalar(const sint16 *accumulator, const sint16 *weights) {
+    std::int32_t sum = 0;
+    for (int i = 0; i < Hidden; ++i) {
+        int value = std::min(std::max(accumulator[i] + featureBias[i], 0), ClipMax);
+        sum += value * weights[i];
+    }
+    return sum;
+}
+
+#ifdef NNUE_SIMD
+
+__attribute__((target("sse2")))
+void addSse2(sint16 *accumulator, const sint16 *weights) {
+    for (int i = 0; i < Hidden; i += 8) {
+        __m128i *a = reinterpret_cast<__m128i*>(accumulator + i);
+        __m128i w = _mm_load_si128(reinterpret_cast<const __m128i*>(weights + i));
+        _mm_storeu_si128(a, _mm_add_epi16(_mm_loadu_si128(a), w));
+    }
+}
+
+__attribute__((target("sse2")))
+void subSse2(sint16 *accumulator, const sint16 *weights) {
+    for (int i = 0; i < Hidden; i += 8) {
+        __m128i *a = reinterpret_cast<__m128i*>(accumulator + i);
+        __m128i w = _mm_load_si128(reinterpret_cast<const __m128i*>(weights + i));
+        _mm_storeu_si128(a, _mm_sub_epi16(_mm_loadu_si128(a), w));
+    }
+}
+
+__attribute__((target("sse2")))
+std::int32_t outputSse2(const sint16 *accumulator, const sint16 *weights) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i clip = _mm_set1_epi16(ClipMax);
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < Hidden; i += 8) {
+        __m128i v = _mm_adds_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(accumulator + i)),
+                                   _mm_load_si128(reinterpret_cast<const __m128i*>(featureBias + i)));
+        v = _mm_min_epi16(_mm_max_epi16(v, zero), clip);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(v, _mm_load_si128(reinterpret_cast<const __m128i*>(weights + i))));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return _mm_cvtsi128_si32(sum);
+}
+
+__attribute__((target("avx2")))
+void addAvx2(sint16 *accumulator, const sint16 *weights) {
+    for (int i = 0; i < Hidden; i += 16) {
+        __m256i *a = reinterpret_cast<__m256i*>(accumulator + i);
+        __m256i w = _mm256_load_si256(reinterpret_cast<const __m256i*>(weights + i));
+        _mm256_storeu_si256(a, _mm256_add_epi16(_mm256_loadu_si256(a), w));
+    }
+}
+
+__attribute__((target("avx2")))
+void subAvx2(sint16 *accumulator, const sint16 *weights) {
+    for (int i = 0; i < Hidden; i += 16) {
+        __m256i *a = reinterpret_cast<__m256i*>(accumulator + i);
+        __m256i w = _mm256_load_si256(reinterpret_cast<const __m256i*>(weights + i));
+        _mm256_storeu_si256(a, _mm256_sub_epi16(_mm256_loadu_si256(a), w));
+    }
+}
+
+__attribute__((target("avx2")))
+std::int32_t outputAvx2(const sint16 *accumulator, const sint16 *weights) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i clip = _mm256_set1_epi16(ClipMax);
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < Hidden; i += 16) {
+        __m256i v = _mm256_adds_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(accumulator + i)),
+                                      _mm256_load_si256(reinterpret_cast<const __m256i*>(featureBias + i)));
+        v = _mm256_min_epi16(_mm256_max_epi16(v, zero), clip);
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(v, _mm256_load_si256(reinterpret_cast<const __m256i*>(weights + i))));
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+    return _mm_cvtsi128_si32(half);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+void addAvx512(sint16 *accumulator, const sint16 *weights) {
+    for (int i = 0; i < Hidden; i += 32) {
+        __m512i w = _mm512_load_si512(weights + i);
+        _mm512_storeu_si512(accumulator + i, _mm512_add_epi16(_mm512_loadu_si512(accumulator + i), w));
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+void subAvx512(sint16 *accumulator, const sint16 *weights) {
+    for (int i = 0; i < Hidden; i += 32) {
+        __m512i w = _mm512_load_si512(weights + i);
+        _mm512_storeu_si512(accumulator + i, _mm512_sub_epi16(_mm512_loadu_si512(accumulator + i), w));
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+std::int32_t outputAvx512(const sint16 *accumulator, const sint16 *weights) {
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i clip = _mm512_set1_epi16(ClipMax);
+    __m512i sum = _mm512_setzero_si512();
+    for (int i = 0; i < Hidden; i += 32) {
+        __m512i v = _mm512_adds_epi16(_mm512_loadu_si512(accumulator + i), _mm512_load_si512(featureBias + i));
+        v = _mm512_min_epi16(_mm512_max_epi16(v, zero), clip);
+        sum = _mm512_add_epi32(sum, _mm512_madd_epi16(v, _mm512_load_si512(weights + i)));
+    }
+    alignas(64) std::int32_t lanes[16];
+    _mm512_store_si512(lanes, sum);
+    std::int32_t total = 0;
+    for (std::int32_t lane : lanes)
+        total += lane;
+    return total;
+}
+
+#endif // NNUE_SIMD
+
+struct Kernels {
+    void (*add)(sint16 *accumulator, const sint16 *weights);
+    void (*sub)(sint16 *accumulator, const sint16 *weights);
+    std::int32_t (*output)(const sint16 *accumulator, const sint16 *weights);
+};
+
+Kernels kernels = { addScalar, subScalar, outputScalar };
+Simd currentSimd = Scalar;
+
+Simd supportedSimd() {
+#ifdef NNUE_SIMD
+    if (__builtin_cpu_supports("avx512bw"))
+        return Avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return Avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return Sse2;
+#endif
+    return Scalar;
+}
+
+// the perspective sums are added in 64 bits, a network can put out anything
+inline Value toCentipawns(std::int64_t sum) {
+    std::int64_t score = (sum / ClipMax + outputBias) * Scale / (ClipMax * OutputQ);
+    return Value(std::max<std::int64_t>(-MaxEval, std::min<std::int64_t>(score, MaxEval)));
+}
+
+} // !anonymous namespace
+
+bool load(const std::string &path)
+{
+    loaded = false;
+
+    std::ifstream file(path, std::ios::binary);
+    uint32 header[2] = {};
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!file || header[0] != Magic || header[1] != uint32(Hidden)) {
+        qDebug() << "Nnue::load() no network of this architecture in" << path.c_str();
+        return false;
+    }
+
+    file.read(reinterpret_cast<char*>(featureWeights), sizeof(featureWeights));
+    file.read(reinterpret_cast<char*>(featureBias), sizeof(featureBias));
+    file.read(reinterpret_cast<char*>(outputWeights), sizeof(outputWeights));
+    file.read(reinterpret_cast<char*>(&outputBias), sizeof(outputBias));
+    if (!file || file.peek() != std::ifstream::traits_type::eof()) {
+        qDebug() << "Nnue::load() truncated or oversized network" << path.c_str();
+        return false;
+    }
+
+    setSimd(Avx512);
+    loaded = true;
+    return true;
+}
+
+Simd setSimd(Simd level)
+{
+    currentSimd = std::min(level, supportedSimd());
+    switch (currentSimd) {
+#ifdef NNUE_SIMD
+    case Avx512: kernels = { addAvx512, subAvx512, outputAvx512 }; break;
+    case Avx2:   kernels = { addAvx2,   subAvx2,   outputAvx2 };   break;
+    case Sse2:   kernels = { addSse2,   subSse2,   outputSse2 };   break;
+#endif
+    default:     kernels = { addScalar, subScalar, outputScalar }; break;
+    }
+    return currentSimd;
+}
+
+Simd simd()
+{
+    return currentSimd;
+}
+
+void addPiece(Accumulator &accumulator, Piece piece, Coord square)
+{
+    kernels.add(accumulator.values[Piece::White], featureWeights[featureIndex(Piece::White, piece, square)]);
+    kernels.add(accumulator.values[Piece::Black], featureWeights[featureIndex(Piece::Black, piece, square)]);
+}
+
+void removePiece(Accumulator &accumulator, Piece piece, Coord square)
+{
+    kernels.sub(accumulator.values[Piece::White], featureWeights[featureIndex(Piece::White, piece, square)]);
+    kernels.sub(accumulator.values[Piece::Black], featureWeights[featureIndex(Piece::Black, piece, square)]);
+}
+
+Value evaluate(const Accumulator &accumulator, Piece::Color side)
+{
+    return toCentipawns(std::int64_t(kernels.output(accumulator.values[side], outputWeights[0]))
+                      + kernels.output(accumulator.values[!side], outputWeights[1]));
+}
+
+Value evaluateScalar(const Accumulator &accumulator, Piece::Color side)
+{
+    return toCentipawns(std::int64_t(outputScalar(accumulator.values[side], outputWeights[0]))
+                      + outputScalar(accumulator.values[!side], outputWeights[1]));
+}
+
+} // !namespace Nnue
+} // !namespace Chess
@@ -0,0 +1,70 @@
+#ifndef NNUE_H
+#define NNUE_H
+
+#include "enginetypes.h"
+
+#include <string>
+
+namespace Chess {
+
+/* Optional neural network evaluation, used instead of the piece-square
+ * tables once a network is loaded.
+ *
+ * The network is 768 -> 2x256 -> 1: one input per color, piece type and
+ * square, seen from each side's perspective. The first layer output, the
+ * accumulator, is kept up to date by Board::setPiece() with one column of
+ * weights added or subtracted per changed square, so a move costs a few
+ * vector adds. The output layer clips both halves, side to move first, and
+ * takes their dot product with the output weights.
+ *
+ * Weights file, little endian:
+ * | Magic | Hidden | feature weights  | feature bias | output weights | output bias |
+ * | u32   | u32    | i16 [768][256]   | i16 [256]    | i16 [2][256]   | i16         | */
+namespace Nnue {
+
+constexpr uint32 Magic  = 0x314e4e43;   // "CNN1"
+constexpr int Inputs    = 768;
+constexpr int Hidden    = 256;
+constexpr int ClipMax   = 255;          // QA, first layer quantization
+constexpr int OutputQ   = 64;           // QB, output layer quantization
+constexpr int Scale     = 400;          // network output to centipawns
+
+struct Accumulator {
+    sint16 values[2][Hidden];           // [perspective], without the feature bias
+};
+
+enum Simd {
+    Scalar,
+    Sse2,
+    Avx2,
+    Avx512
+};
+
+// loads the weights and picks the widest kernels the cpu supports, false if the file is unusable;
+// positions set up before the load have to refresh their accumulator
+bool load(const std::string &path);
+
+extern bool loaded;
+
+inline bool isLoaded() {
+    return loaded;
+}
+
+// caps the kernels at level, for verification and benchmarks; returns the level in use
+Simd setSimd(Simd level);
+Simd simd();
+
+// moves the feature of piece on square in or out of the accumulator, both perspectives
+void addPiece(Accumulator &accumulator, Piece piece, Coord square);
+void removePiece(Accumulator &accumulator, Piece piece, Coord square);
+
+// centipawns from the point of view of side, within MaxEval
+Value evaluate(const Accumulator &accumulator, Piece::Color side);
+
+// the same without SIMD, the reference for the vectorized kernels
+Value evaluateScalar(const Accumulator &accumulator, Piece::Color side);
+
+} // !namespace Nnue
+} // !namespace Chess
+
+#endif // NNUE_H
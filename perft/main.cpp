@@ -0,0 +1,119 @@
+#include "perft.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+using namespace Chess;
+
+static void usage()
+{
+    std::cout << "usage: perft [options] <depth> [fen]\n"
+                 "       perft [options] -suite [max depth]\n"
+                 "options:\n"
+                 "  -divide       print the node count of every root move\n"
+                 "  -threads <n>  split the root moves between n threads (default: all cores)\n"
+                 "  -hash <mb>    cache subtree counts in a table of mb megabytes (default: off)\n";
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return std::max(elapsed.count(), 1e-6); // prevent the good old divide by 0 problem :)
+}
+
+static Perft::Count run(const Board &board, int depth, unsigned int threads, bool showDivide, double &seconds)
+{
+    auto start = std::chrono::steady_clock::now();
+    Vector<Perft::DivideEntry> entries = Perft::divide(board, depth, threads);
+    seconds = secondsSince(start);
+
+    Perft::Count total = 0;
+    for (const Perft::DivideEntry &entry : entries) {
+        total += entry.nodes;
+        if (showDivide)
+            std::cout << Perft::moveToString(entry.move) << ": " << entry.nodes << "\n";
+    }
+    return total;
+}
+
+static int runSuite(int maxDepth, unsigned int threads)
+{
+    int failed = 0;
+    Perft::Count totalNodes = 0;
+    double totalSeconds = 0;
+
+    for (const Perft::SuitePosition &position : Perft::suite()) {
+        Board board = Board::fromFEN(position.fen);
+        int depth = std::min<int>(maxDepth, position.expected.size());
+        Perft::Count expected = position.expected[depth - 1];
+
+        double seconds;
+        Perft::Count nodes = run(board, depth, threads, false, seconds);
+        totalNodes   += nodes;
+        totalSeconds += seconds;
+
+        bool ok = (nodes == expected);
+        failed += !ok;
+        std::cout << (ok ? "ok     " : "FAILED ") << position.fen << "\n"
+                  << "       depth " << depth << ": " << nodes << " (expected " << expected << "), "
+                  << Perft::Count(nodes / seconds) << " nodes/s\n";
+    }
+
+    std::cout << "\n" << (failed ? "FAILED: " : "passed: ")
+              << Perft::suite().size() - failed << "/" << Perft::suite().size() << " positions, "
+              << Perft::Count(totalNodes / totalSeconds) << " nodes/s\n";
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+    bool showDivide = false;
+    bool suite = false;
+    unsigned int threads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::size_t hashMegabytes = 0;
+    Vector<std::string> arguments;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "-divide")) {
+            showDivide = true;
+        } else if (!std::strcmp(argv[i], "-suite")) {
+            suite = true;
+        } else if (!std::strcmp(argv[i], "-threads") && i + 1 < argc) {
+            threads = std::max(std::atoi(argv[++i]), 1);
+        } else if (!std::strcmp(argv[i], "-hash") && i + 1 < argc) {
+            hashMegabytes = std::max(std::atoi(argv[++i]), 0);
+        } else {
+            arguments.push_back(argv[i]);
+        }
+    }
+
+    Perft::setHashSize(hashMegabytes);
+
+    if (suite)
+        return runSuite(arguments.empty() ? 5 : std::max(std::atoi(arguments[0].c_str()), 1), threads);
+
+    if (arguments.empty()) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    int depth = std::max(std::atoi(arguments[0].c_str()), 1);
+
+    /* the fen may be passed quoted or as separate words */
+    std::string fen;
+    for (std::size_t i = 1; i < arguments.size(); ++i)
+        fen += (i > 1 ? " " : "") + arguments[i];
+    if (fen.empty())
+        fen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+    double seconds;
+    Perft::Count nodes = run(Board::fromFEN(fen), depth, threads, showDivide, seconds);
+
+    std::cout << "\nNodes: " << nodes
+              << "\nTime: " << int(seconds * 1000) << " ms"
+              << "\nNodes/s: " << Perft::Count(nodes / seconds) << "\n";
+    return EXIT_SUCCESS;
+}
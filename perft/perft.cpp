@@ -0,0 +1,211 @@
+#include "perft.h"
+#include "abstractthread.h"
+
+#include <atomic>
+#include <memory>
+
+namespace Chess {
+namespace Perft {
+
+namespace {
+
+/* Lockless table, an entry is valid only if check == key ^ depth ^ nodes,
+ * so a torn write by a concurrent thread reads as a miss. */
+class PerftHash {
+    struct Entry {
+        std::atomic<std::uint64_t> check;
+        std::atomic<std::uint64_t> nodes;
+    };
+
+    std::unique_ptr<Entry[]> entries;
+    std::size_t mask = 0;
+
+    static std::uint64_t depthKey(int depth) {
+        return std::uint64_t(depth) * 0x9E3779B97F4A7C15ULL;
+    }
+
+public:
+    void resize(std::size_t megabytes) {
+        entries.reset();
+        mask = 0;
+
+        std::size_t count = megabytes * 1024 * 1024 / sizeof(Entry);
+        if (count == 0)
+            return;
+
+        std::size_t size = 1;
+        while (size * 2 <= count)
+            size *= 2;
+
+        entries.reset(new Entry[size]);
+        for (std::size_t i = 0; i < size; ++i) {
+            entries[i].check.store(0, std::memory_order_relaxed);
+            entries[i].nodes.store(0, std::memory_order_relaxed);
+        }
+        mask = size - 1;
+    }
+
+    bool enabled() const {
+        return mask != 0;
+    }
+
+    bool probe(Key key, int depth, Count &nodes) const {
+        const Entry &e = entries[key & mask];
+        Count n = e.nodes.load(std::memory_order_relaxed);
+        if ((e.check.load(std::memory_order_relaxed) ^ n) != (key ^ depthKey(depth)))
+            return false;
+        nodes = n;
+        return true;
+    }
+
+    void store(Key key, int depth, Count nodes) {
+        Entry &e = entries[key & mask];
+        e.check.store(key ^ depthKey(depth) ^ nodes, std::memory_order_relaxed);
+        e.nodes.store(nodes, std::memory_order_relaxed);
+    }
+} hash;
+
+/* pulls root moves from a shared counter until all of them are counted */
+class PerftThread : public AbstractThread {
+public:
+    Board board;
+    const MoveList *rootMoves = nullptr;
+    Vector<Count> *counts = nullptr;
+    std::atomic<std::size_t> *nextMove = nullptr;
+    int depth = 0;
+
+protected:
+    void run() override {
+        std::size_t i;
+        while ((i = nextMove->fetch_add(1)) < rootMoves->size()) {
+            board.make((*rootMoves)[i]);
+            (*counts)[i] = perft(board, depth - 1);
+            board.unmake();
+        }
+    }
+};
+
+} // !anonymous namespace
+
+Count perft(Board &board, int depth)
+{
+    if (depth == 0)
+        return 1;
+
+    // a hit saves the move generation as well, the leaves are counted without the table
+    if (depth > 1 && hash.enabled()) {
+        Count cached;
+        if (hash.probe(board.key(), depth, cached))
+            return cached;
+    }
+
+    MoveList movesList;
+    board.possibleMoves(board.side(), movesList);
+
+    if (depth == 1)
+        return movesList.size();  // bulk counting
+
+    Count nodes = 0;
+    for (Move move : movesList) {
+        board.make(move);
+        nodes += perft(board, depth - 1);
+        board.unmake();
+    }
+
+    if (hash.enabled())
+        hash.store(board.key(), depth, nodes);
+
+    return nodes;
+}
+
+Vector<DivideEntry> divide(const Board &board, int depth, unsigned int threadsCount)
+{
+    MoveList rootMoves;
+    board.possibleMoves(board.side(), rootMoves);
+
+    Vector<Count> counts(rootMoves.size(), 0);
+    std::atomic<std::size_t> nextMove(0);
+
+    if (depth > 1) {
+        threadsCount = std::max(threadsCount, 1u);
+        Vector<std::unique_ptr<PerftThread>> threads;
+        for (unsigned int i = 0; i < threadsCount; ++i) {
+            threads.emplace_back(new PerftThread());
+            threads[i]->board     = board;
+            threads[i]->rootMoves = &rootMoves;
+            threads[i]->counts    = &counts;
+            threads[i]->nextMove  = &nextMove;
+            threads[i]->depth     = depth;
+            threads[i]->start();
+        }
+        for (auto &thread : threads)
+            thread->waitForFinish();
+    } else {
+        std::fill(counts.begin(), counts.end(), 1);
+    }
+
+    Vector<DivideEntry> result;
+    for (std::size_t i = 0; i < rootMoves.size(); ++i)
+        result.push_back(DivideEntry{rootMoves[i], counts[i]});
+    return result;
+}
+
+void setHashSize(std::size_t megabytes)
+{
+    hash.resize(megabytes);
+}
+
+const Vector<SuitePosition> &suite()
+{
+    static const Vector<SuitePosition> positions = {
+        { "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+          { 20, 400, 8902, 197281, 4865609, 119060324 } },
+        { "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+          { 48, 2039, 97862, 4085603, 193690690 } },
+        { "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+          { 14, 191, 2812, 43238, 674624, 11030083 } },
+        { "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+          { 6, 264, 9467, 422333, 15833292 } },
+        { "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+          { 44, 1486, 62379, 2103487, 89941194 } },
+        { "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+          { 46, 2079, 89890, 3894594, 164075551 } },
+        // en passant, castling and promotion corner cases
+        { "3k4/3p4/8/K1P4r/8/8/8/8 b - - 0 1",
+          { 18, 92, 1670, 10138, 185429, 1134888 } },
+        { "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",
+          { 15, 126, 1928, 13931, 206379, 1440467 } },
+        { "r3k2r/1b4bq/8/8/8/8/7B/R3K2R w KQkq - 0 1",
+          { 26, 1141, 27826, 1274206 } },
+        { "r3k2r/8/3Q4/8/8/5q2/8/R3K2R b KQkq - 0 1",
+          { 44, 1494, 50509, 1720476 } },
+        { "2K2r2/4P3/8/8/8/8/8/3k4 w - - 0 1",
+          { 11, 133, 1442, 19174, 266199, 3821001 } },
+        { "8/k1P5/8/1K6/8/8/8/8 w - - 0 1",
+          { 10, 25, 268, 926, 10857, 43261, 567584 } }
+    };
+    return positions;
+}
+
+std::string moveToString(Move move)
+{
+    std::string result;
+    result += char('a' + move.origin().file());
+    result += char('1' + move.origin().rank());
+    result += char('a' + move.target().file());
+    result += char('1' + move.target().rank());
+
+    if (move.isPromotion()) {
+        switch (move.type()) {
+        case Move::PromoteToQueen:  result += 'q'; break;
+        case Move::PromoteToKnight: result += 'n'; break;
+        case Move::PromoteToRook:   result += 'r'; break;
+        case Move::PromoteToBishop: result += 'b'; break;
+        default:;
+        }
+    }
+    return result;
+}
+
+} // !namespace Perft
+} // !namespace Chess
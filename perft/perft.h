@@ -0,0 +1,40 @@
+#ifndef PERFT_H
+#define PERFT_H
+
+#include "board.h"
+
+#include <string>
+
+namespace Chess {
+namespace Perft {
+
+using Count = std::uint64_t;
+
+struct DivideEntry {
+    Move  move;
+    Count nodes;
+};
+
+struct SuitePosition {
+    const char *fen;
+    Vector<Count> expected;  // expected[d-1] is the node count at depth d
+};
+
+// number of leaf nodes at depth, leaves are bulk-counted from the move list size
+Count perft(Board &board, int depth);
+
+// node count of every root move, the root moves are shared between threadsCount threads
+Vector<DivideEntry> divide(const Board &board, int depth, unsigned int threadsCount = 1);
+
+// caches subtree counts shared by all perft threads, 0 disables the cache
+void setHashSize(std::size_t megabytes);
+
+// well known positions with verified node counts
+const Vector<SuitePosition> &suite();
+
+std::string moveToString(Move move);
+
+} // !namespace Perft
+} // !namespace Chess
+
+#endif // PERFT_H
@@ -0,0 +1,40 @@
+QMAKE_CXXFLAGS += -std=c++11
+QT += core
+QT -= gui
+
+TARGET = perft
+CONFIG += console
+CONFIG -= app_bundle
+
+# keep in sync with ChessEngine.pro
+pext {
+    DEFINES += USE_PEXT
+    QMAKE_CXXFLAGS += -mbmi2
+}
+
+# "qmake CONFIG+=verify_keys" recomputes the position key, the piece-square scores
+# and the network accumulator after every make/unmake
+verify_keys {
+    DEFINES += VERIFY_KEYS
+}
+
+INCLUDEPATH += ..
+
+SOURCES += main.cpp \
+    perft.cpp \
+    ../board.cpp \
+    ../bitboard.cpp \
+    ../zobrist.cpp \
+    ../nnue.cpp \
+    ../abstractthread.cpp
+
+HEADERS += \
+    perft.h \
+    ../board.h \
+    ../bitboard.h \
+    ../zobrist.h \
+    ../psqt.h \
+    ../nnue.h \
+    ../evaluate.h \
+    ../enginetypes.h \
+    ../abstractthread.h
@@ -0,0 +1,165 @@
+#ifndef PSQT_H
+#define PSQT_H
+
+#include "enginetypes.h"
+
+namespace Chess {
+namespace Psqt {
+
+// game phase weight of the pieces, the full set of minor and major pieces makes MaxPhase
+constexpr int PhaseWeight[7] = { 0, 0, 1, 1, 2, 4, 0 };
+constexpr int MaxPhase = 24;
+
+// material in centipawns, indexed by Piece::Type
+constexpr Value ValueMg[7] = { 0, 100, 320, 330, 500, 950, 0 };
+constexpr Value ValueEg[7] = { 0, 130, 300, 320, 540, 950, 0 };
+
+/* Bonus tables from White's point of view as seen from White's side of the
+ * board: the first row is the eighth rank. */
+constexpr int PawnMg[64] = {
+      0,   0,   0,   0,   0,   0,   0,   0,
+     50,  50,  50,  50,  50,  50,  50,  50,
+     10,  10,  20,  30,  30,  20,  10,  10,
+      5,   5,  10,  25,  25,  10,   5,   5,
+      0,   0,   0,  20,  20,   0,   0,   0,
+      5,  -5, -10,   0,   0, -10,  -5,   5,
+      5,  10,  10, -20, -20,  10,  10,   5,
+      0,   0,   0,   0,   0,   0,   0,   0
+};
+
+// in the endgame a pawn is worth the more the closer it is to promotion
+constexpr int PawnEg[64] = {
+      0,   0,   0,   0,   0,   0,   0,   0,
+     90,  90,  90,  90,  90,  90,  90,  90,
+     60,  60,  60,  60,  60,  60,  60,  60,
+     35,  35,  35,  35,  35,  35,  35,  35,
+     20,  20,  20,  20,  20,  20,  20,  20,
+     10,  10,  10,  10,  10,  10,  10,  10,
+      5,   5,   5,   5,   5,   5,   5,   5,
+      0,   0,   0,   0,   0,   0,   0,   0
+};
+
+constexpr int Knight[64] = {
+    -50, -40, -30, -30, -30, -30, -40, -50,
+    -40, -20,   0,   0,   0,   0, -20, -40,
+    -30,   0,  10,  15,  15,  10,   0, -30,
+    -30,   5,  15,  20,  20,  15,   5, -30,
+    -30,   0,  15,  20,  20,  15,   0, -30,
+    -30,   5,  10,  15,  15,  10,   5, -30,
+    -40, -20,   0,   5,   5,   0, -20, -40,
+    -50, -40, -30, -30, -30, -30, -40, -50
+};
+
+constexpr int Bishop[64] = {
+    -20, -10, -10, -10, -10, -10, -10, -20,
+    -10,   0,   0,   0,   0,   0,   0, -10,
+    -10,   0,   5,  10,  10,   5,   0, -10,
+    -10,   5,   5,  10,  10,   5,   5, -10,
+    -10,   0,  10,  10,  10,  10,   0, -10,
+    -10,  10,  10,  10,  10,  10,  10, -10,
+    -10,   5,   0,   0,   0,   0,   5, -10,
+    -20, -10, -10, -10, -10, -10, -10, -20
+};
+
+constexpr int Rook[64] = {
+      0,   0,   0,   0,   0,   0,   0,   0,
+      5,  10,  10,  10,  10,  10,  10,   5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+      0,   0,   0,   5,   5,   0,   0,   0
+};
+
+constexpr int Queen[64] = {
+    -20, -10, -10,  -5,  -5, -10, -10, -20,
+    -10,   0,   0,   0,   0,   0,   0, -10,
+    -10,   0,   5,   5,   5,   5,   0, -10,
+     -5,   0,   5,   5,   5,   5,   0,  -5,
+      0,   0,   5,   5,   5,   5,   0,  -5,
+    -10,   5,   5,   5,   5,   5,   0, -10,
+    -10,   0,   5,   0,   0,   0,   0, -10,
+    -20, -10, -10,  -5,  -5, -10, -10, -20
+};
+
+// the king hides behind its pawns while the queens are on and walks to the center later
+constexpr int KingMg[64] = {
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -20, -30, -30, -40, -40, -30, -30, -20,
+    -10, -20, -20, -20, -20, -20, -20, -10,
+     20,  20,   0,   0,   0,   0,  20,  20,
+     20,  30,  10,   0,   0,  10,  30,  20
+};
+
+constexpr int KingEg[64] = {
+    -50, -40, -30, -20, -20, -30, -40, -50,
+    -30, -20, -10,   0,   0, -10, -20, -30,
+    -30, -10,  20,  30,  30,  20, -10, -30,
+    -30, -10,  30,  40,  40,  30, -10, -30,
+    -30, -10,  30,  40,  40,  30, -10, -30,
+    -30, -10,  20,  30,  30,  20, -10, -30,
+    -30, -30,   0,   0,   0,   0, -30, -30,
+    -50, -30, -30, -30, -30, -30, -30, -50
+};
+
+constexpr int bonusMg(int type, int index) {
+    return type == Piece::Pawn   ? PawnMg[index] : type == Piece::Knight ? Knight[index]
+         : type == Piece::Bishop ? Bishop[index] : type == Piece::Rook   ? Rook[index]
+         : type == Piece::Queen  ? Queen[index]  : type == Piece::King   ? KingMg[index] : 0;
+}
+
+constexpr int bonusEg(int type, int index) {
+    return type == Piece::Pawn   ? PawnEg[index] : type == Piece::Knight ? Knight[index]
+         : type == Piece::Bishop ? Bishop[index] : type == Piece::Rook   ? Rook[index]
+         : type == Piece::Queen  ? Queen[index]  : type == Piece::King   ? KingEg[index] : 0;
+}
+
+// material plus bonus from White's point of view, Black reads the tables mirrored
+constexpr Score entry(int color, int type, int square) {
+    return color == Piece::White
+            ?  Score(ValueMg[type] + bonusMg(type, square ^ 56), ValueEg[type] + bonusEg(type, square ^ 56))
+            : -Score(ValueMg[type] + bonusMg(type, square),      ValueEg[type] + bonusEg(type, square));
+}
+
+/* The lookup table is generated at compile time, one row of 64 squares per
+ * color and piece type, expanded from a pack of square indices. */
+struct Row {
+    Score squares[64];
+};
+
+template <int... I> struct Squares {};
+template <int N, int... I> struct MakeSquares : MakeSquares<N - 1, N - 1, I...> {};
+template <int... I> struct MakeSquares<0, I...> { using type = Squares<I...>; };
+
+template <int... I>
+constexpr Row makeRow(int color, int type, Squares<I...>) {
+    return Row{{ entry(color, type, I)... }};
+}
+
+constexpr Row row(int color, int type) {
+    return makeRow(color, type, MakeSquares<64>::type());
+}
+
+// [color][type], all zero for Piece::Empty
+constexpr Row Table[2][7] = {
+    { row(0, 0), row(0, 1), row(0, 2), row(0, 3), row(0, 4), row(0, 5), row(0, 6) },
+    { row(1, 0), row(1, 1), row(1, 2), row(1, 3), row(1, 4), row(1, 5), row(1, 6) }
+};
+
+static_assert(Table[Piece::White][Piece::Knight].squares[1] == -Table[Piece::Black][Piece::Knight].squares[57],
+              "Psqt: Black's table must mirror White's");
+static_assert(Table[Piece::White][Piece::Pawn].squares[52].eg() == ValueEg[Piece::Pawn] + PawnEg[12],
+              "Psqt: the first table row must be the eighth rank");
+
+constexpr Score piece(Piece piece, Coord square) {
+    return Table[piece.color()][piece.type()].squares[square];
+}
+
+} // !namespace Psqt
+} // !namespace Chess
+
+#endif // PSQT_H
@@ -3,47 +3,375 @@
 #include "enginetypes.h"
 #include "evaluate.h"
 
+#include <cmath>
+#include <cstring>
+
 namespace Chess {
 
 template<typename T>
 Vector<Vector<T> > splitVector(const Vector<T>& vect, int splitTo=2);
 
-Search::Search(unsigned int threadsCount) {
+Search::Search(unsigned int threadsCount, std::size_t hashMegabytes)
+    : tt(hashMegabytes), parallelMode(LazySmp), idleThreads(0), infoCallback(nullptr), warmStart(false) {
 
+    threadsCount = std::max(threadsCount, 1u);
     threads.resize(threadsCount);
-    for(int i = 0; i<threadsCount; ++i) {
-        threads[i] = new MinimaxSearchThread();
+    for(unsigned int i = 0; i<threadsCount; ++i) {
+        threads[i] = new MinimaxSearchThread(this, &tt, &limits, i);
     }
+    driver.search = this;
+    for (MinimaxSearchThread *thread : threads)
+        thread->setPool(&threads, &idleThreads);
+}
+
+void Search::setHashSize(std::size_t megabytes) {
+    tt.resize(megabytes);
+}
+
+void Search::setParallelMode(ParallelMode mode) {
+    parallelMode = mode;
+}
+
+/* Time allocation: with a clock the search aims at a fraction of the remaining
+ * time plus most of the increment, and may overrun it up to a hard maximum
+ * when an iteration is still running. */
+void SearchLimits::start(const SearchRequest &request)
+{
+    constexpr int MoveOverhead = 50;    // ms lost outside the search, e.g. by the GUI
+
+    startTime = now();
+    pondering = request.ponder;
+    nodeLimit = request.nodes;
+    maxDepth  = (request.depth > 0) ? std::min(request.depth, MaxPly - 1) : MaxPly - 1;
+    nodes = 0;
+    evalStats.clear();
+    stop = false;
+
+    int myTime = (request.board.side() == Piece::White) ? request.wtime : request.btime;
+    int myInc  = (request.board.side() == Piece::White) ? request.winc  : request.binc;
+
+    if (request.movetime > 0) {
+        optimumTime = maximumTime = std::max(request.movetime - MoveOverhead, 1);
+    } else if (myTime > 0) {
+        int available = std::max(myTime - MoveOverhead, 1);
+        optimumTime = std::min(available / 40 + myInc * 3 / 4, available);
+        maximumTime = std::min(optimumTime * 4, available / 3);
+        optimumTime = std::max(std::min(optimumTime, maximumTime), 1);
+        maximumTime = std::max(maximumTime, optimumTime);
+    } else {
+        optimumTime = maximumTime = 0;
+    }
+}
+
+bool SearchLimits::iterationsDone(int depth, Value score) const
+{
+    // no time for a further iteration
+    if (optimumTime && !pondering && elapsed() >= optimumTime)
+        return true;
+    // a mate within the searched depth is proven
+    if (std::abs(score) >= MateBound && depth >= MateScore - std::abs(score))
+        return true;
+    if (nodeLimit && nodes >= nodeLimit)
+        return true;
+    return depth >= maxDepth;
+}
+
+void SearchLimits::waitWhilePondering() const
+{
+    while (pondering && !stop)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+void SharedEvalStats::clear()
+{
+    pawnHits = pawnMisses = evalHits = evalMisses = lazyExits = 0;
+}
+
+void SharedEvalStats::add(const Evaluate::Stats &stats)
+{
+    pawnHits.fetch_add(stats.pawnHits, std::memory_order_relaxed);
+    pawnMisses.fetch_add(stats.pawnMisses, std::memory_order_relaxed);
+    evalHits.fetch_add(stats.evalHits, std::memory_order_relaxed);
+    evalMisses.fetch_add(stats.evalMisses, std::memory_order_relaxed);
+    lazyExits.fetch_add(stats.lazyExits, std::memory_order_relaxed);
+}
+
+Evaluate::Stats SharedEvalStats::load() const
+{
+    Evaluate::Stats stats;
+    stats.pawnHits   = pawnHits.load(std::memory_order_relaxed);
+    stats.pawnMisses = pawnMisses.load(std::memory_order_relaxed);
+    stats.evalHits   = evalHits.load(std::memory_order_relaxed);
+    stats.evalMisses = evalMisses.load(std::memory_order_relaxed);
+    stats.lazyExits  = lazyExits.load(std::memory_order_relaxed);
+    return stats;
 }
 
 SearchResult Search::search(SearchRequest request) {
 
+    stop();
+    limits.start(request);
+    return run(request, nullptr);
+}
+
+std::shared_ptr<SearchHandle> Search::start(const SearchRequest &request, SearchResultCallback onFinished,
+                                            SearchInfoCallback onInfo) {
+    stop();
+
+    // the clock starts now, and a stop() right after start() is not lost
+    limits.start(request);
+
+    driver.request    = request;
+    driver.onFinished = onFinished;
+    driver.onInfo     = onInfo;
+    driver.handle     = std::shared_ptr<SearchHandle>(new SearchHandle(&limits));
+    driver.start();
+    return driver.handle;
+}
+
+void Search::stop() {
+    if (driver.isRunning()) {
+        limits.stop = true;
+        driver.waitForFinish();
+    }
+}
+
+void Search::ponderHit() {
+    limits.startTime = SearchLimits::now();
+    limits.pondering = false;
+}
+
+void Search::Driver::run() {
+    SearchResult result = search->run(request, onInfo ? &onInfo : nullptr);
+    if (onFinished)
+        onFinished(result);
+    handle->finish(result);
+}
+
+void Search::reportIteration(int depth, const Vector<PvLine> &lines) {
+    if (!infoCallback || lines.empty())
+        return;
+
+    SearchInfo info;
+    info.depth = depth;
+    info.score = lines[0].score;
+    info.time  = limits.elapsed();
+    info.nodes = limits.nodes;
+    info.nps   = info.nodes * 1000 / std::max(info.time, 1);
+    info.pv    = lines[0].moves;
+    info.lines = lines;
+    info.evalStats = limits.evalStats.load();
+    info.hashfull  = tt.hashfull();
+    (*infoCallback)(info);
+}
+
+SearchResult Search::run(const SearchRequest &request, const SearchInfoCallback *onInfo) {
+
+    infoCallback = onInfo;
+
+    // after a ponder miss the table entries and the history stay as warm as they are
+    if (!warmStart)
+        tt.newSearch();
+    for (MinimaxSearchThread *thread : threads)
+        thread->newSearch(!warmStart);
+
+    SearchResult result;
+    if (parallelMode == RootSplit)
+        result = searchRootSplit(request);
+    else if (parallelMode == Ybwc)
+        result = searchYbwc(request);
+    else
+        result = searchLazySmp(request);
+
+    result.evalStats = limits.evalStats.load();
+    result.hashfull  = tt.hashfull();
+    warmStart = limits.pondering;   // stopped before the ponder hit
+    infoCallback = nullptr;
+    return result;
+}
+
+void SearchHandle::stop()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!finished)
+        limits->stop = true;
+}
+
+void SearchHandle::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    finishedCv.wait(lock, [this](){ return finished; });
+}
+
+bool SearchHandle::isFinished()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return finished;
+}
+
+SearchResult SearchHandle::result()
+{
+    wait();
+    return searchResult;
+}
+
+void SearchHandle::finish(const SearchResult &result)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    searchResult = result;
+    finished = true;
+    lock.unlock();
+    finishedCv.notify_all();
+}
+
+/* The main thread deepens iteratively, the other threads idle until it
+ * offers the remaining moves of a node as a split point, join it and may
+ * split the subtrees they search again in turn. */
+SearchResult Search::searchYbwc(const SearchRequest &request) {
+
+    idleThreads = 0;
+    threads[0]->setIterativeSearch(request, threads.size() > 1);
+    for (std::size_t i = 1; i < threads.size(); ++i)
+        threads[i]->setHelper(request);
+
+    for (MinimaxSearchThread *thread : threads)
+        thread->start();
+
+    SearchResult result = threads[0]->getSearchResult();
+    for (std::size_t i = 1; i < threads.size(); ++i)
+        result.moveCnt += threads[i]->getSearchResult().moveCnt;
+
+    return result;
+}
+
+/* Every thread runs its own iterative deepening over the whole tree. They
+ * help each other only through the transposition table: a helper that is
+ * ahead fills the table with results the others pick up. Helpers skip some
+ * depths, so the threads are spread over several depths at any time. */
+SearchResult Search::searchLazySmp(const SearchRequest &request) {
+
+    for (MinimaxSearchThread *thread : threads) {
+        thread->setIterativeSearch(request);
+        thread->start();
+    }
+
+    Vector<SearchResult> threadResults;
+    for (MinimaxSearchThread *thread : threads)
+        threadResults.push_back(thread->getSearchResult());
+
+    /* a helper that completed a deeper iteration wins, the main thread on a
+     * tie: its result is the one the time management verified. With MultiPV
+     * the lines of the main thread are kept. */
+    SearchResult result = threadResults[0];
+    result.moveCnt = 0;
+    for (const SearchResult &threadResult : threadResults) {
+        result.moveCnt += threadResult.moveCnt;
+        if (request.multiPv > 1)
+            continue;
+        if (threadResult.depth > result.depth) {
+            result.moves = threadResult.moves;
+            result.score = threadResult.score;
+            result.depth = threadResult.depth;
+            result.lines = threadResult.lines;
+        }
+    }
+    result.request = request;
+    return result;
+}
+
+SearchResult Search::searchRootSplit(const SearchRequest &request) {
+
     // get all possible moves //
     Vector<Move> possibleMoves = request.board.possibleMoves(request.board.side());
 
     // split the moves between threads //
     Vector<Vector<Move>> threadMoves = splitVector(possibleMoves, threads.size() );
 
+    SearchResult result;
+    result.request = request;
+    result.moveCnt = 0;
+    result.depth = 0;
+    result.score = 0;
+
+    const int sign = (request.board.side() == Piece::White) ? 1 : -1;
+    int moveCnt = 0;
+
+    for (int depth = 1; depth <= limits.maxDepth; ++depth) {
+
+        // the previous score is a good guess, search a narrow window around it
+        Value delta = AspirationWindow;
+        Value previous = sign * result.score;
+        Value alpha = -InfiniteScore;
+        Value beta  = +InfiniteScore;
+        if (depth >= 4 && std::abs(previous) < MateBound) {
+            alpha = std::max(previous - delta, -InfiniteScore);
+            beta  = std::min(previous + delta, +InfiniteScore);
+        }
+
+        SearchResult iteration;
+        for (;;) {
+            iteration = searchIteration(request, threadMoves, depth, alpha, beta);
+            moveCnt += iteration.moveCnt;
 
-    // start each thread
-    for (int i=0; i < threads.size(); ++i){
+            Value score = sign * iteration.score;
+            if (limits.stop || (score > alpha && score < beta))
+                break;
+
+            // the score fell outside of the window: widen it on that side and search again
+            delta *= 2;
+            if (score <= alpha)
+                alpha = (delta > MateScore) ? -InfiniteScore : std::max(score - delta, -InfiniteScore);
+            else
+                beta  = (delta > MateScore) ? +InfiniteScore : std::min(score + delta, +InfiniteScore);
+        }
+
+        // an aborted iteration is incomplete, the last completed one is played
+        if (limits.stop && depth > 1)
+            break;
+
+        result.moves = iteration.moves;
+        result.score = iteration.score;
+        result.depth = depth;
+        result.lines = { PvLine{result.score, result.moves} };
+        reportIteration(depth, result.lines);
+
+        if (limits.iterationsDone(depth, result.score))
+            break;
+    }
+
+    limits.waitWhilePondering();
+    result.moveCnt = moveCnt;
+    return result;
+}
+
+SearchResult Search::searchIteration(const SearchRequest &request, const Vector<Vector<Move>> &threadMoves,
+                                     int depth, Value alpha, Value beta) {
+
+    // start each thread, an empty filter would search all moves
+    Vector<std::size_t> started;
+    for (std::size_t i=0; i < threads.size(); ++i){
+        if (threadMoves[i].empty() && i > 0)
+            continue;   // more threads than root moves
+        started.push_back(i);
         SearchRequest threadRequest = request;
+        threadRequest.depth = depth;
         threadRequest.movesFilter = threadMoves[i];
-        threads[i]->setSearchRequest(threadRequest);
+        threads[i]->setSearchRequest(threadRequest, alpha, beta);
         threads[i]->start();
     }
 
-    Vector<SearchResult> threadResults(threads.size());
-    for (int i=0; i < threads.size(); ++i){
-        threadResults[i] = threads[i]->getSearchResult();
+    Vector<SearchResult> threadResults;
+    for (std::size_t i : started){
+        threadResults.push_back(threads[i]->getSearchResult());
     }
 
     SearchResult result;
     result.request = request;
     result.moveCnt = 0;
-    result.score = (request.board.side() == Piece::White) ? -INFINITY : +INFINITY;
+    result.depth = depth;
+    result.score = (request.board.side() == Piece::White) ? -InfiniteScore : +InfiniteScore;
 
-    for (int i=0; i < threads.size(); ++i) {
+    for (std::size_t i=0; i < threadResults.size(); ++i) {
         result.moveCnt += threadResults[i].moveCnt;
         if (request.board.side() == Piece::White && threadResults[i].score > result.score) {
             result.score = threadResults[i].score;
@@ -57,81 +385,789 @@ SearchResult Search::search(SearchRequest request) {
     return result;
 }
 
-void MinimaxSearchThread::setSearchRequest(const SearchRequest &request)
+MinimaxSearchThread::MinimaxSearchThread(Search *search, TranspositionTable *table, SearchLimits *searchLimits, int index)
+    : owner(search), tt(table), limits(searchLimits), threadIndex(index), iterative(false),
+      helper(false), canSplit(false), activeSplitPoint(nullptr), pool(nullptr), idleThreads(nullptr)
+{
+    std::memset(history, 0, sizeof(history));
+    newSearch();
+}
+
+void MinimaxSearchThread::newSearch(bool age)
+{
+    // the killers are tied to the plies of the previous root
+    for (auto &plyKillers : killers)
+        plyKillers[0] = plyKillers[1] = Move();
+
+    if (age) {
+        for (auto &sideHistory : history)
+            for (auto &fromHistory : sideHistory)
+                for (int &h : fromHistory)
+                    h /= 2;
+
+        for (auto &fromMoves : counterMoves)
+            for (Move &move : fromMoves)
+                move = Move();
+    }
+
+    previousPv.clear();
+}
+
+void MinimaxSearchThread::setPool(const Vector<MinimaxSearchThread*> *threads, std::atomic<int> *idle)
+{
+    pool = threads;
+    idleThreads = idle;
+}
+
+void MinimaxSearchThread::setSearchRequest(const SearchRequest &request, Value alpha, Value beta)
 {
+    iterative = false;
+    helper = false;
+    canSplit = false;
+    activeSplitPoint = nullptr;
     board = request.board;
+    board.refreshAccumulator();
+    rootAlpha = alpha;
+    rootBeta = beta;
 
     sr.request = request;
     sr.moves.clear();
-    sr.moves.resize(sr.request.depth);
+    sr.lines.clear();
+    rootExcluded.clear();
+    rootMovesDone = board.movesDone.size();
+    pvLength[0] = 0;
     sr.moveCnt = 0;
 }
 
+void MinimaxSearchThread::setIterativeSearch(const SearchRequest &request, bool splitting)
+{
+    setSearchRequest(request);
+    iterative = true;
+    canSplit = splitting;
+    sr.depth = 0;
+}
+
+void MinimaxSearchThread::setHelper(const SearchRequest &request)
+{
+    setSearchRequest(request);
+    helper = true;
+    canSplit = true;
+    sr.depth = 0;
+}
+
 SearchResult MinimaxSearchThread::getSearchResult()
 {
     waitForFinish();
     return sr;
 }
 
-real MinimaxSearchThread::minimax(int depth)
+/* the shared counter is updated in batches, it is read by all threads */
+void MinimaxSearchThread::checkLimits()
 {
-    if (depth == 0)
-        return Evaluate::position(board);
+    constexpr int NodesBatch = 1024;
 
-    Vector<Move> movesList;
-    if (depth == sr.request.depth && sr.request.movesFilter.size() > 0 )
-        movesList = sr.request.movesFilter;
-    else
-        movesList = board.possibleMoves(board.side());
+    std::uint64_t nodes = limits->nodes.fetch_add(NodesBatch, std::memory_order_relaxed) + NodesBatch;
+    if (limits->nodeLimit && nodes >= limits->nodeLimit)
+        limits->stop = true;
+    if (limits->maximumTime && !limits->pondering && limits->elapsed() >= limits->maximumTime)
+        limits->stop = true;
+
+    reportEvalStats();
+}
+
+void MinimaxSearchThread::reportEvalStats()
+{
+    Evaluate::Stats stats = evalContext.stats;
+    stats -= reportedStats;
+    limits->evalStats.add(stats);
+    reportedStats = evalContext.stats;
+}
+
+namespace {
 
-    std::random_shuffle(movesList.begin(), movesList.end()); // randomize the order of the moves
+// move ordering classes, a class always sorts before all lower ones
+constexpr int TTMoveScore      = 1 << 30;
+constexpr int GoodCaptureScore = 1 << 28;   // captures and queen promotions
+constexpr int KillerScore      = 1 << 27;
+constexpr int CounterMoveScore = 1 << 26;
+constexpr int MaxHistory       = 1 << 14;   // bound of the quiet move history
+constexpr int BadCaptureScore  = -(1 << 20);  // captures losing material by SEE
+constexpr int UnderPromoScore  = -(1 << 21);
+
+constexpr Value DeltaMargin = 200; // positional swing a capture may bring beyond its material
+
+constexpr int   FutilityDepth         = 2;
+constexpr Value FutilityMargin        = 100;    // per ply of remaining depth
+constexpr int   ReverseFutilityDepth  = 3;
+constexpr Value ReverseFutilityMargin = 120;    // per ply of remaining depth
+constexpr int   NullMoveDepth         = 3;
+constexpr int   ReductionDepth        = 3;
+constexpr std::size_t ReductionIndex = 3;      // the first moves of the order are never reduced
+
+inline bool isQuiet(Move move) {
+    return !(move.flags() & Move::CaptureFlag) && !move.isPromotion();
+}
+
+/* moves the highest scored of the remaining moves to index i */
+inline Move pickMove(MoveList &moves, int *scores, std::size_t i) {
+    std::size_t best = i;
+    for (std::size_t j = i + 1; j < moves.size(); ++j)
+        if (scores[j] > scores[best])
+            best = j;
+    std::swap(moves[i], moves[best]);
+    std::swap(scores[i], scores[best]);
+    return moves[i];
+}
+
+/* history gravity: the bonus shrinks as the entry approaches MaxHistory */
+inline void updateHistoryEntry(int &entry, int bonus) {
+    entry += bonus - entry * std::abs(bonus) / MaxHistory;
+}
+
+} // !anonymous namespace
+
+/* TT move, winning and equal captures by MVV-LVA (most valuable victim, least valuable attacker),
+ * killers, the countermove, the other quiet moves by their history, then losing captures */
+void MinimaxSearchThread::scoreMoves(const MoveList &moves, int *scores, Move ttMove, int ply) const
+{
+    Move previous = board.movesDone.empty() ? Move() : board.movesDone.back();
+    Move counter  = previous.isValid() ? counterMoves[previous.origin()][previous.target()] : Move();
+    Piece::Color side = board.side();
+
+    for (std::size_t i = 0; i < moves.size(); ++i) {
+        Move move = moves[i];
+        if (move == ttMove) {
+            scores[i] = TTMoveScore;
+        } else if (!isQuiet(move)) {
+            Piece::Type victim   = (move.type() == Move::EnPassant) ? Piece::Pawn : board[move.target()].type();
+            Piece::Type attacker = board[move.origin()].type();
+            if (move.isPromotion() && move.type() != Move::PromoteToQueen)
+                scores[i] = UnderPromoScore + victim;
+            else
+                scores[i] = (board.see(move) < 0 ? BadCaptureScore : GoodCaptureScore)
+                          + (victim + (move.isPromotion() ? Piece::Queen : 0)) * 8 - attacker;
+        } else if (move == killers[ply][0]) {
+            scores[i] = KillerScore + 1;
+        } else if (move == killers[ply][1]) {
+            scores[i] = KillerScore;
+        } else if (move == counter) {
+            scores[i] = CounterMoveScore;
+        } else {
+            scores[i] = history[side][move.origin()][move.target()];
+        }
+    }
+}
+
+/* a quiet move caused a cutoff: reward it and penalize the quiet moves tried before it */
+void MinimaxSearchThread::updateQuietStats(Move bestMove, const MoveList &quietsTried, int depth, int ply)
+{
+    if (!(killers[ply][0] == bestMove)) {
+        killers[ply][1] = killers[ply][0];
+        killers[ply][0] = bestMove;
+    }
+
+    if (!board.movesDone.empty() && board.movesDone.back().isValid()) {
+        Move previous = board.movesDone.back();
+        counterMoves[previous.origin()][previous.target()] = bestMove;
+    }
+
+    int bonus = std::min(depth * depth, 400);
+    Piece::Color side = board.side();
+    for (Move move : quietsTried)
+        updateHistoryEntry(history[side][move.origin()][move.target()], move == bestMove ? bonus : -bonus);
+}
+
+Move MinimaxSearchThread::previousPvMove(int ply) const
+{
+    if (ply >= int(previousPv.size()) || board.movesDone.size() != rootMovesDone + ply)
+        return Move();
+    for (int i = 0; i < ply; ++i)
+        if (!(board.movesDone[rootMovesDone + i] == previousPv[i]))
+            return Move();
+    return previousPv[ply];
+}
+
+/* Late move reductions: quiet moves late in the order rarely turn out best,
+ * they are searched shallower first, more so the later they come and the
+ * worse their history is. */
+int MinimaxSearchThread::reduction(Move move, std::size_t index, int depth, int ply, bool inCheck) const
+{
+    if (!sr.request.options.lateMoveReductions || depth < ReductionDepth || index < ReductionIndex
+            || inCheck || !isQuiet(move) || move == killers[ply][0] || move == killers[ply][1]
+            || board.isKingAttacked(board.side()))  // gives check
+        return 0;
+
+    int r = 1 + (index >= 6) + (depth >= 6);
+    int h = history[!board.side()][move.origin()][move.target()];
+    if (h > MaxHistory / 2)
+        --r;
+    else if (h < 0)
+        ++r;
+    return std::max(0, std::min(r, depth - 2));
+}
+
+/* mate scores count the plies from the root, the table stores them relative to the node */
+static inline Value scoreToTT(Value score, int ply) {
+    return score >= MateBound ? score + ply : score <= -MateBound ? score - ply : score;
+}
+
+static inline Value scoreFromTT(Value score, int ply) {
+    return score >= MateBound ? score - ply : score <= -MateBound ? score + ply : score;
+}
+
+/* Negamax alpha-beta with principal variation search: the first move is
+ * searched with the full window, the others with a zero window around alpha
+ * and searched again only if they unexpectedly beat it.
+ * Scores are from the point of view of the side to move. */
+Value MinimaxSearchThread::alphaBeta(Value alpha, Value beta, int depth, int ply)
+{
+    const bool pvNode = (beta - alpha > ScoreGrain);
+    const bool rootNode = (ply == 0);
+    const SearchOptions &options = sr.request.options;
+
+    pvLength[ply] = ply;
+
+    if (stopped())
+        return 0;
+
+    // a repetition is scored as a draw right away, the side ahead has to find something better
+    if (!rootNode && board.isDraw())
+        return 0;
+
+    const bool inCheck = board.isKingAttacked(board.side());
+
+    // check extension: a check is resolved before the horizon
+    if (inCheck && options.checkExtensions && !rootNode)
+        ++depth;
+
+    if (depth <= 0 || ply >= MaxPly - 1)
+        return quiescence(alpha, beta, ply);
+
+    // mate distance pruning: no line from here can beat a mate found closer to the root
+    if (!rootNode) {
+        alpha = std::max(alpha, -MateScore + ply);
+        beta  = std::min(beta,   MateScore - ply - 1);
+        if (alpha >= beta)
+            return alpha;
+    }
+
+    // the root moves may be filtered, so the root never returns a stored score
+    TranspositionTable::Entry entry;
+    bool ttHit = tt->probe(board.key(), entry);
+    if (ttHit && !pvNode && !rootNode && entry.depth >= depth) {
+        Value ttScore = scoreFromTT(entry.score, ply);
+        if ((entry.bound & TranspositionTable::LowerBound) && ttScore >= beta)
+            return ttScore;
+        if ((entry.bound & TranspositionTable::UpperBound) && ttScore <= alpha)
+            return ttScore;
+    }
+
+    Value staticEval = -InfiniteScore;
+    if (!inCheck && !pvNode)
+        staticEval = evaluate();
+
+    // reverse futility: near the leaves a big enough lead is not going to vanish
+    if (options.reverseFutility && !pvNode && !inCheck && depth <= ReverseFutilityDepth
+            && std::abs(beta) < MateBound && staticEval - ReverseFutilityMargin * depth >= beta)
+        return staticEval;
+
+    /* Null move: if passing still fails high, a real move will too. Not in
+     * zugzwang prone positions, with pawns and the king only, and never twice
+     * in a row. */
+    if (options.nullMove && !pvNode && !inCheck && depth >= NullMoveDepth && staticEval >= beta
+            && std::abs(beta) < MateBound
+            && (board.pieces(board.side()) & ~board.pieces(Piece::Pawn) & ~board.pieces(Piece::King))
+            && !board.isAfterNullMove()) {
+        int R = 2 + depth / 4;
+        board.makeNullMove();
+        Value score = -alphaBeta(-beta, -beta + ScoreGrain, depth - 1 - R, ply + 1);
+        board.unmake();
+
+        if (stopped())
+            return 0;
+        if (score >= beta)
+            return score >= MateBound ? beta : score;   // unproven mates are not returned
+    }
+
+    MoveList movesList;
+    if (rootNode && sr.request.movesFilter.size() > 0 ) {
+        for (Move move : sr.request.movesFilter)
+            movesList.push_back(move);
+    } else {
+        board.possibleMoves(board.side(), movesList);
+    }
+
+    if (rootNode && !rootExcluded.empty()) {
+        MoveList rootMoves;
+        for (Move move : movesList)
+            if (std::find(rootExcluded.begin(), rootExcluded.end(), move) == rootExcluded.end())
+                rootMoves.push_back(move);
+        movesList = rootMoves;
+    }
 
     /* No Valid Moves */
     if (movesList.size() == 0) {
-        if (board.isKingAttacked(board.side())) {
-            return board.side() == Piece::White ? -1000.0+(sr.request.depth-depth) : +1000.0-(sr.request.depth-depth);
+        if (inCheck) {
+            return -MateScore + ply;
         } else {
-            return 0.0;     // It's a draw
+            return 0;       // It's a draw
         }
     }
 
-    float bestValue = (board.side() == Piece::White) ? -INFINITY : +INFINITY;
+    // futility: near the leaves quiet moves can't make up for a too big deficit
+    const bool futile = options.futility && !pvNode && !inCheck && depth <= FutilityDepth
+            && std::abs(alpha) < MateBound && staticEval + FutilityMargin * depth <= alpha;
+
+    // the move of the previous PV or the stored best move goes first, it is the most likely to be the best again
+    Move hashMove = pvNode ? previousPvMove(ply) : Move();
+    if (!hashMove.isValid() && ttHit)
+        hashMove = entry.move;
+
+    int scores[MoveList::Capacity];
+    scoreMoves(movesList, scores, hashMove, ply);
+
+    const Value oldAlpha = alpha;
+    Value bestScore = -InfiniteScore;
+    Move bestMove;
+    MoveList quietsTried;
+
+    for (std::size_t i = 0; i < movesList.size(); ++i) {
+        Move move = pickMove(movesList, scores, i);
 
-    for (Move move : movesList) {
         board.make(move);
+        if ((++sr.moveCnt & 1023) == 0)
+            checkLimits();
+
+        if (futile && i > 0 && isQuiet(move) && !board.isKingAttacked(board.side())) {
+            board.unmake();
+            bestScore = std::max(bestScore, staticEval + FutilityMargin * depth);
+            continue;
+        }
+
+        if (isQuiet(move))
+            quietsTried.push_back(move);
+
+        Value score;
+        if (i == 0) {
+            score = -alphaBeta(-beta, -alpha, depth-1, ply+1);
+        } else {
+            int r = reduction(move, i, depth, ply, inCheck);
+            score = -alphaBeta(-alpha-ScoreGrain, -alpha, depth-1-r, ply+1);
+            if (r > 0 && score > alpha)
+                score = -alphaBeta(-alpha-ScoreGrain, -alpha, depth-1, ply+1);
+            if (pvNode && score > alpha && score < beta)
+                score = -alphaBeta(-beta, -alpha, depth-1, ply+1);
+        }
+
+        board.unmake();
+
+        // the score of an aborted search is meaningless
+        if (stopped())
+            return 0;
+
+        if (score > bestScore) {
+            bestScore = score;
+            if (score > alpha) {
+                alpha = score;
+                bestMove = move;
+                if (pvNode)
+                    updatePv(ply, move);
+                if (alpha >= beta) {
+                    if (isQuiet(move))
+                        updateQuietStats(move, quietsTried, depth, ply);
+                    break;  // cutoff, the opponent will avoid this position
+                }
+            }
+        }
+
+        // young brothers wait: with the eldest brother searched the others may be shared
+        if (canSplit && !rootNode && depth >= SplitMinDepth && i + 1 < movesList.size()
+                && idleThreads->load(std::memory_order_relaxed) > 0) {
+            SplitPoint sp;
+            sp.board = board;
+            for (std::size_t j = i + 1; j < movesList.size(); ++j)
+                sp.moves.push_back(pickMove(movesList, scores, j));
+            sp.alpha = alpha;
+            sp.beta = beta;
+            sp.bestScore = bestScore;
+            sp.bestMove = bestMove;
+            sp.pvLength = pvLength[ply];
+            std::copy(pvTable[ply] + ply, pvTable[ply] + pvLength[ply], sp.pv + ply);
+            sp.depth = depth;
+            sp.ply = ply;
+            sp.pvNode = pvNode;
+            sp.inCheck = inCheck;
+            sp.firstIndex = i + 1;
+            sp.parent = activeSplitPoint;
+
+            {
+                std::lock_guard<std::mutex> lock(splitPointsMutex);
+                splitPoints.push_back(&sp);
+            }
+
+            searchSplitPoint(sp);
+
+            {
+                std::lock_guard<std::mutex> lock(splitPointsMutex);
+                splitPoints.pop_back();
+            }
+            // sp is on this stack, the helpers must be done with it
+            if (sp.helpers.load(std::memory_order_acquire) > 0)
+                helpHelpers(sp);
+
+            if (stopped())
+                return 0;
+
+            bestScore = sp.bestScore;
+            bestMove  = sp.bestMove;
+            pvLength[ply] = sp.pvLength;
+            std::copy(sp.pv + ply, sp.pv + sp.pvLength, pvTable[ply] + ply);
+            if (sp.alpha > alpha && bestScore >= beta && isQuiet(bestMove))
+                updateQuietStats(bestMove, quietsTried, depth, ply);
+            break;
+        }
+    }
+
+    if (!rootNode || (sr.request.movesFilter.empty() && rootExcluded.empty())) {
+        TranspositionTable::Bound bound = bestScore >= beta   ? TranspositionTable::LowerBound
+                                        : bestScore > oldAlpha ? TranspositionTable::ExactBound
+                                                               : TranspositionTable::UpperBound;
+        tt->store(board.key(), bestMove, scoreToTT(bestScore, ply), depth, bound);
+    }
+
+    return bestScore;
+}
+
+void MinimaxSearchThread::searchSplitPoint(SplitPoint &sp)
+{
+    SplitPoint *outer = activeSplitPoint;
+    activeSplitPoint = &sp;
+
+    std::size_t i;
+    while (!stopped() && (i = sp.nextMove.fetch_add(1)) < sp.moves.size()) {
+        Move move = sp.moves[i];
+
+        Value alpha;
+        {
+            std::lock_guard<std::mutex> lock(sp.mutex);
+            alpha = sp.alpha;
+        }
+
+        board.make(move);
+        if ((++sr.moveCnt & 1023) == 0)
+            checkLimits();
+
+        int r = reduction(move, sp.firstIndex + i, sp.depth, sp.ply, sp.inCheck);
+        Value score = -alphaBeta(-alpha-ScoreGrain, -alpha, sp.depth-1-r, sp.ply+1);
+        if (r > 0 && score > alpha)
+            score = -alphaBeta(-alpha-ScoreGrain, -alpha, sp.depth-1, sp.ply+1);
+        if (sp.pvNode && score > alpha && score < sp.beta)
+            score = -alphaBeta(-sp.beta, -alpha, sp.depth-1, sp.ply+1);
+
+        board.unmake();
+
+        if (stopped())
+            break;
+
+        std::lock_guard<std::mutex> lock(sp.mutex);
+        if (score > sp.bestScore) {
+            sp.bestScore = score;
+            if (score > sp.alpha) {
+                sp.alpha = score;
+                sp.bestMove = move;
+                if (sp.pvNode) {
+                    updatePv(sp.ply, move);
+                    sp.pvLength = pvLength[sp.ply];
+                    std::copy(pvTable[sp.ply] + sp.ply, pvTable[sp.ply] + sp.pvLength, sp.pv + sp.ply);
+                }
+                if (sp.alpha >= sp.beta)
+                    sp.cutoff = true;
+            }
+        }
+    }
+
+    activeSplitPoint = outer;
+}
+
+/* joining happens under the lock of the owner's queue, so a split point
+ * can't be joined anymore once its owner took it off the queue */
+SplitPoint * MinimaxSearchThread::stealWork(const SplitPoint *below)
+{
+    const std::size_t count = pool->size();
+    for (std::size_t k = 1; k < count; ++k) {
+        MinimaxSearchThread *victim = (*pool)[(threadIndex + k) % count];
+        std::lock_guard<std::mutex> lock(victim->splitPointsMutex);
+        for (SplitPoint *sp : victim->splitPoints) {
+            if (sp->cutoff || sp->nextMove.load(std::memory_order_relaxed) >= sp->moves.size())
+                continue;
+            // the ancestors of a joinable split point are alive, their owners wait for it
+            const SplitPoint *ancestor = sp->parent;
+            while (below && ancestor && ancestor != below)
+                ancestor = ancestor->parent;
+            if (below && !ancestor)
+                continue;
+            sp->helpers.fetch_add(1, std::memory_order_acq_rel);
+            return sp;
+        }
+    }
+    return nullptr;
+}
+
+/* Helpful master: the threads working at sp split their subtrees as well,
+ * the owner searches there instead of idling until they are done. Those
+ * split points end before sp does, so the owner is never held up by work
+ * that isn't its own. */
+void MinimaxSearchThread::helpHelpers(SplitPoint &sp)
+{
+    Board position = board;
+
+    idleThreads->fetch_add(1);
+    while (sp.helpers.load(std::memory_order_acquire) > 0) {
+        SplitPoint *below = stealWork(&sp);
+        if (!below) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        idleThreads->fetch_sub(1);
+        board = below->board;
+        searchSplitPoint(*below);
+        below->helpers.fetch_sub(1, std::memory_order_acq_rel);
+        idleThreads->fetch_add(1);
+    }
+    idleThreads->fetch_sub(1);
+
+    board = position;
+}
+
+void MinimaxSearchThread::helperLoop()
+{
+    idleThreads->fetch_add(1);
+    while (!limits->stop.load(std::memory_order_relaxed)) {
+        SplitPoint *sp = stealWork();
+        if (!sp) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        idleThreads->fetch_sub(1);
+        board = sp->board;
+        sr.request.depth = sp->depth;
+        searchSplitPoint(*sp);
+        sp->helpers.fetch_sub(1, std::memory_order_acq_rel);
+        idleThreads->fetch_add(1);
+    }
+    idleThreads->fetch_sub(1);
+}
+
+/* Searches captures and promotions only, until the position is quiet.
+ * The side to move may stand pat on the static evaluation instead of capturing,
+ * except when in check, then all evasions are searched. */
+Value MinimaxSearchThread::quiescence(Value alpha, Value beta, int ply)
+{
+    pvLength[ply] = ply;
+
+    if (stopped())
+        return 0;
+
+    const bool inCheck = board.isKingAttacked(board.side());
+    Value standPat = -InfiniteScore;
+
+    if (!inCheck || ply >= MaxPly - 1) {
+        standPat = evaluate(alpha, beta);
+
+        if (standPat >= beta || ply >= MaxPly - 1)
+            return standPat;
+        alpha = std::max(alpha, standPat);
+    }
+
+    MoveList movesList;
+    board.possibleCaptures(board.side(), movesList);
+
+    if (inCheck && movesList.empty())
+        return -MateScore + ply;
+
+    int scores[MoveList::Capacity];
+    scoreMoves(movesList, scores, Move(), ply);
+
+    Value bestScore = standPat;
 
-        float val = minimax( depth-1 );
-        if (board.side() != Piece::White && val > bestValue) {
-            bestValue = val;
-            sr.moves[sr.request.depth-depth] = move; // save the best move
-        } else if (board.side() != Piece::Black && val < bestValue) {
-            bestValue = val;
-            sr.moves[sr.request.depth-depth] = move; // save the  best move
+    for (std::size_t i = 0; i < movesList.size(); ++i) {
+        Move move = pickMove(movesList, scores, i);
+
+        if (!inCheck) {
+            // scoreMoves() put the captures losing material by SEE and the underpromotions last
+            if (scores[i] < 0)
+                break;
+
+            // delta pruning: even winning the captured piece can't raise alpha
+            Piece::Type victim = (move.type() == Move::EnPassant) ? Piece::Pawn : board[move.target()].type();
+            if (!move.isPromotion() && standPat + Evaluate::PieceValue[victim] + DeltaMargin <= alpha)
+                continue;
         }
 
+        board.make(move);
+        if ((++sr.moveCnt & 1023) == 0)
+            checkLimits();
+
+        Value score = -quiescence(-beta, -alpha, ply+1);
+
         board.unmake();
-        sr.moveCnt++;
+
+        if (stopped())
+            return 0;
+
+        if (score > bestScore) {
+            bestScore = score;
+            if (score > alpha) {
+                alpha = score;
+                if (alpha >= beta)
+                    break;
+            }
+        }
     }
 
-    return bestValue;
+    return bestScore;
+}
+
+/* Iterative deepening with aspiration windows. The main thread searches all
+ * depths and ends the search, the helpers skip depths following the pattern
+ * of their index so that each depth is searched by about half of the threads. */
+void MinimaxSearchThread::iterativeDeepening()
+{
+    static const int SkipSize[]  = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+    static const int SkipPhase[] = { 0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7 };
+    const int skipIndex = (threadIndex - 1) % 20;
+
+    // MultiPV is the main thread's job, the helpers fill the table for it
+    std::size_t lineCount = 1;
+    if (threadIndex == 0 && sr.request.multiPv > 1) {
+        MoveList rootMoves;
+        board.possibleMoves(board.side(), rootMoves);
+        lineCount = std::max<std::size_t>(1, std::min<std::size_t>(sr.request.multiPv, rootMoves.size()));
+    }
+
+    const int sign = (board.side() == Piece::White) ? 1 : -1;
+    Vector<PvLine> lines;       // of the last completed iteration, side to move point of view
+    int completedDepth = 0;
+
+    for (int depth = 1; depth <= limits->maxDepth; ++depth) {
+
+        if (threadIndex > 0 && depth > 1 && ((depth + SkipPhase[skipIndex]) / SkipSize[skipIndex]) % 2)
+            continue;
+
+        sr.request.depth = depth;
+
+        /* each line is the best of the root moves not leading a better line,
+         * all of them share the table and the ordering tables */
+        Vector<PvLine> iterationLines;
+        rootExcluded.clear();
+
+        for (std::size_t pvIndex = 0; pvIndex < lineCount; ++pvIndex) {
+            Value previousScore = pvIndex < lines.size() ? lines[pvIndex].score : 0;
+            previousPv = pvIndex < lines.size() ? lines[pvIndex].moves : Vector<Move>();
+
+            Value delta = AspirationWindow;
+            Value alpha = -InfiniteScore;
+            Value beta  = +InfiniteScore;
+            if (depth >= 4 && pvIndex < lines.size() && std::abs(previousScore) < MateBound) {
+                alpha = std::max(previousScore - delta, -InfiniteScore);
+                beta  = std::min(previousScore + delta, +InfiniteScore);
+            }
+
+            Value score;
+            for (;;) {
+                score = alphaBeta(alpha, beta, depth, 0);
+                if (stopped() || (score > alpha && score < beta))
+                    break;
+
+                delta *= 2;
+                if (score <= alpha)
+                    alpha = (delta > MateScore) ? -InfiniteScore : std::max(score - delta, -InfiniteScore);
+                else
+                    beta  = (delta > MateScore) ? +InfiniteScore : std::min(score + delta, +InfiniteScore);
+            }
+
+            if (stopped())
+                break;
+
+            // no move left: a root without legal moves is a line of its own, mated or stalemate;
+            // with MultiPV the root moves ran out before the lines did
+            if (pvLength[0] == 0) {
+                if (pvIndex == 0)
+                    iterationLines.push_back(PvLine{score, Vector<Move>()});
+                break;
+            }
+
+            iterationLines.push_back(PvLine{score, Vector<Move>(pvTable[0], pvTable[0] + pvLength[0])});
+            rootExcluded.push_back(pvTable[0][0]);
+        }
+        rootExcluded.clear();
+
+        if (stopped() || iterationLines.empty())
+            break;
+
+        std::stable_sort(iterationLines.begin(), iterationLines.end(),
+                         [](const PvLine &a, const PvLine &b) { return a.score > b.score; });
+        lines = iterationLines;
+        previousPv = lines[0].moves;
+        completedDepth = depth;
+
+        if (threadIndex == 0) {
+            Vector<PvLine> whiteLines = lines;
+            for (PvLine &line : whiteLines)
+                line.score *= sign;
+            owner->reportIteration(depth, whiteLines);
+        }
+
+        // a mate ends the search only once every line is proven
+        if (limits->stop || limits->iterationsDone(depth, lines.back().score))
+            break;
+    }
+
+    // the helpers are done once the main thread is
+    if (threadIndex == 0) {
+        limits->waitWhilePondering();
+        limits->stop = true;
+    }
+
+    sr.lines = lines;
+    for (PvLine &line : sr.lines)
+        line.score *= sign;
+    sr.moves = lines.empty() ? Vector<Move>() : lines[0].moves;
+    sr.score = lines.empty() ? 0 : lines[0].score * sign;
+    sr.depth = completedDepth;
 }
 
 void MinimaxSearchThread::run()
 {
-    sr.score = minimax(sr.request.depth);
+    if (helper) {
+        helperLoop();
+    } else if (iterative) {
+        iterativeDeepening();
+    } else {
+        Value score = alphaBeta(rootAlpha, rootBeta, sr.request.depth, 0);
+        sr.score = (board.side() == Piece::White ? score : -score);
+        sr.moves.assign(pvTable[0], pvTable[0] + pvLength[0]);
+        sr.lines = { PvLine{sr.score, sr.moves} };
+        previousPv = sr.moves;
+    }
+
+    // the counts of the last batch, the result of the search is complete
+    reportEvalStats();
 }
 
 
 
 template<typename T>
-Vector<Vector<T> > splitVector(const Vector<T>& vect, int splitTo=2) {
+Vector<Vector<T> > splitVector(const Vector<T>& vect, int splitTo) {
 
     Vector<Vector<T> > result(splitTo);
 
     int splitSize = vect.size()/splitTo;
     splitSize     = std::max(splitSize, 1);  // check for 0 division;
 
-    for (int i = 0; i < vect.size(); ++i) {
+    for (int i = 0; i < int(vect.size()); ++i) {
         int whichSplit = (i / splitSize) % splitTo;
         result[whichSplit].push_back(vect[i]);
     }
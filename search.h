@@ -4,35 +4,307 @@
 #include "enginetypes.h"
 #include "board.h"
 #include "abstractthread.h"
+#include "transpositiontable.h"
+#include "evaluate.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 
 namespace Chess {
 
+constexpr Value InfiniteScore = MateScore + 1;  // all scores fit the 16 bits of a table entry
+constexpr Value ScoreGrain = 1;                 // smallest score step, the width of a zero window
+
+constexpr Value AspirationWindow = 50;         // initial half width around the previous score
+
+/* Selectivity of the search, each technique can be switched off alone to measure it */
+struct SearchOptions {
+    bool nullMove = true;           // null move pruning
+    bool lateMoveReductions = true;
+    bool futility = true;           // futility pruning of quiet moves near the leaves
+    bool reverseFutility = true;    // static null move pruning
+    bool checkExtensions = true;
+    bool lazyEval = true;           // quiescence stand pat from the material estimate far outside the window
+    Value lazyMargin = Evaluate::LazyMargin;    // how far outside, tuned against SearchResult::evalStats.lazyExits
+};
+
+/* The search deepens iteratively until one of the limits is hit.
+ * Times are in milliseconds, a zero value disables the limit.
+ * Without any limit the search goes on until MaxPly. */
 struct SearchRequest {
     Board board;
-    int depth;
+    int depth = 0;                  // maximum depth
     Vector<Move> movesFilter;
+
+    int movetime = 0;               // exact time for this move
+    int wtime = 0;                  // time left on the clocks
+    int btime = 0;
+    int winc = 0;                   // increment per move
+    int binc = 0;
+    std::uint64_t nodes = 0;        // node limit
+
+    // searches the position after the expected reply while the opponent thinks,
+    // the time limits apply only from Search::ponderHit() on
+    bool ponder = false;
+
+    // number of best root moves searched each with its own score and PV,
+    // ignored by the root split mode
+    int multiPv = 1;
+
+    SearchOptions options;
+};
+
+struct PvLine {
+    Value score;                    // White's point of view
+    Vector<Move> moves;
 };
 
 struct SearchResult {
     SearchRequest request;
     Vector<Move> moves;
-    real score;
+    Value score;
     int moveCnt;
+    int depth;                      // depth of the last completed iteration
+    Vector<PvLine> lines;           // the request.multiPv best lines, best first; lines[0] is moves and score
+    Evaluate::Stats evalStats;      // evaluation counters of all threads during this search
+    int hashfull;                   // permille of the table written by this search
+};
+
+/* Progress report, sent after each completed iteration */
+struct SearchInfo {
+    int depth = 0;
+    Value score = 0;                // White's point of view, as SearchResult::score
+    std::uint64_t nodes = 0;
+    std::uint64_t nps = 0;
+    int time = 0;                   // ms since the start of the search
+    Vector<Move> pv;
+    Vector<PvLine> lines;           // with MultiPV, pv and score are those of lines[0]
+    Evaluate::Stats evalStats;      // so far, as current as nodes
+    int hashfull = 0;               // permille of the table written by this search so far
+};
+
+using SearchInfoCallback   = std::function<void(const SearchInfo&)>;
+using SearchResultCallback = std::function<void(const SearchResult&)>;
+
+/* Evaluation counters of the running search, each thread adds its own in batches like the nodes */
+struct SharedEvalStats {
+    std::atomic<std::uint64_t> pawnHits;
+    std::atomic<std::uint64_t> pawnMisses;
+    std::atomic<std::uint64_t> evalHits;
+    std::atomic<std::uint64_t> evalMisses;
+    std::atomic<std::uint64_t> lazyExits;
+
+    SharedEvalStats()
+        : pawnHits(0), pawnMisses(0), evalHits(0), evalMisses(0), lazyExits(0) {}
+
+    void clear();
+    void add(const Evaluate::Stats &stats);
+    Evaluate::Stats load() const;
+};
+
+/* Limits of the running search, shared by Search and all its threads */
+struct SearchLimits {
+    int optimumTime = 0;            // no new iteration is started after it
+    int maximumTime = 0;            // the running iteration is aborted after it
+    std::uint64_t nodeLimit = 0;
+    int maxDepth = MaxPly - 1;
+
+    std::atomic<std::int64_t> startTime;    // ms on the steady clock, restarted by a ponder hit
+    std::atomic<std::uint64_t> nodes;
+    SharedEvalStats evalStats;
+    std::atomic<bool> stop;
+    std::atomic<bool> pondering;    // the time limits don't apply yet
+
+    SearchLimits()
+        : startTime(0), nodes(0), stop(false), pondering(false) {}
+
+    void start(const SearchRequest &request);
+
+    // true if no further iteration should follow the one completed at depth with score
+    bool iterationsDone(int depth, Value score) const;
+
+    // a finished ponder search holds its result back until the ponder hit or the stop
+    void waitWhilePondering() const;
+
+    static std::int64_t now() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    int elapsed() const {
+        return int(now() - startTime.load(std::memory_order_relaxed));
+    }
 };
 
+constexpr int SplitMinDepth = 4;   // shallower nodes are not worth sharing between threads
+
+/* YBWC: a node whose first move is searched and whose remaining moves may be
+ * searched by several threads at once. It lives on the stack of its owner,
+ * which waits for all helpers before returning from the node. */
+struct SplitPoint {
+    Board board;                        // position at the node, helpers start from a copy
+    MoveList moves;                     // remaining moves, in search order
+    std::atomic<std::size_t> nextMove;
+    std::atomic<int> helpers;           // threads other than the owner working here
+    std::atomic<bool> cutoff;           // a beta cutoff makes the remaining work useless
+
+    std::mutex mutex;                   // guards the fields below
+    Value alpha;
+    Value beta;
+    Value bestScore;
+    Move bestMove;
+
+    Move pv[MaxPly + 1];                // best line from the node, pv[ply] is the best move
+    int pvLength;
+
+    int depth;
+    int ply;
+    bool pvNode;
+    bool inCheck;
+    std::size_t firstIndex;             // index of moves[0] in the move order of the node
+    SplitPoint *parent;                 // a cutoff in any ancestor stops the work here too
+
+    SplitPoint()
+        : nextMove(0), helpers(0), cutoff(false) {}
+};
+
+class Search;
+
 class MinimaxSearchThread : public AbstractThread {
 
+    Search *owner;
     Board board;
     SearchResult sr;
+    TranspositionTable *tt;
+    SearchLimits *limits;
+    const int threadIndex;          // 0 is the main thread, it controls the time
+    bool iterative;                 // deepen iteratively or search the single depth of the request
+    Value rootAlpha;
+    Value rootBeta;
+
+    // YBWC
+    bool helper;                    // waits for split points to join instead of searching a request
+    bool canSplit;
+    SplitPoint *activeSplitPoint;   // innermost split point the thread is working at
+    std::mutex splitPointsMutex;
+    // open split points, innermost at the back; a plain queue under splitPointsMutex,
+    // the owner pushes and pops at the back, thieves look from the front
+    std::deque<SplitPoint*> splitPoints;
+    const Vector<MinimaxSearchThread*> *pool;
+    std::atomic<int> *idleThreads;
+
+    // move ordering heuristics, they persist across the iterations of a search
+    Move killers[MaxPly][2];            // quiet moves that caused a cutoff at the same ply
+    int history[2][64][64];             // [side][from][to] success of quiet moves
+    Move counterMoves[64][64];          // refutation of the previous move [from][to]
+
+    Evaluate::Context evalContext;      // pawn hash of this thread, kept across searches
+    Evaluate::Stats reportedStats;      // part of evalContext.stats already added to the shared counters
+
+    /* Triangular PV table: pvTable[ply][ply..pvLength[ply]) is the best line
+     * found from the node at ply, a node takes over the line of its best child. */
+    Move pvTable[MaxPly + 1][MaxPly + 1];
+    int pvLength[MaxPly + 1];
+    Vector<Move> previousPv;            // line of the last completed iteration, searched first
+    std::size_t rootMovesDone;          // board.movesDone.size() at the root
+    Vector<Move> rootExcluded;          // MultiPV: root moves of the better lines of the iteration
 
 public:
 
-    void setSearchRequest(const SearchRequest& request);
+    MinimaxSearchThread(Search *search, TranspositionTable *table, SearchLimits *searchLimits, int index);
+
+    // sr.request.depth is the depth of the single iteration this thread runs
+    void setSearchRequest(const SearchRequest& request, Value alpha = -InfiniteScore, Value beta = +InfiniteScore);
+
+    // Lazy SMP: the thread deepens on its own up to the limits, the result is its deepest completed iteration
+    void setIterativeSearch(const SearchRequest& request, bool splitting = false);
+
+    // YBWC: the thread helps at the split points of the other threads until the search stops
+    void setHelper(const SearchRequest& request);
+
+    void setPool(const Vector<MinimaxSearchThread*> *threads, std::atomic<int> *idle);
     SearchResult getSearchResult();
 
+    // forgets the killers and unless told otherwise ages the history, called once before each search
+    void newSearch(bool age = true);
+
 private:
 
-    real minimax(int depth);
+    // scores the moves for pickMove(), most promising first
+    void scoreMoves(const MoveList &moves, int *scores, Move ttMove, int ply) const;
+
+    void updateQuietStats(Move bestMove, const MoveList &quietsTried, int depth, int ply);
+
+    // static evaluation from the point of view of the side to move
+    inline Value evaluate() {
+        Value score = Evaluate::position(board, evalContext);
+        return board.side() == Piece::White ? score : -score;
+    }
+
+    // the same, possibly lazy outside the window [alpha, beta]
+    inline Value evaluate(Value alpha, Value beta) {
+        if (!sr.request.options.lazyEval)
+            return evaluate();
+        const Value margin = sr.request.options.lazyMargin;
+        if (board.side() == Piece::White)
+            return Evaluate::position(board, evalContext, alpha, beta, margin);
+        return -Evaluate::position(board, evalContext, -beta, -alpha, margin);
+    }
+
+    inline void updatePv(int ply, Move move) {
+        pvTable[ply][ply] = move;
+        for (int i = ply + 1; i < pvLength[ply + 1]; ++i)
+            pvTable[ply][i] = pvTable[ply + 1][i];
+        pvLength[ply] = std::max(pvLength[ply + 1], ply + 1);
+    }
+
+    // the move of the previous iteration's PV at ply, if the current line follows that PV
+    Move previousPvMove(int ply) const;
+
+    // plies the move, the index-th tried in its node, is reduced by; the move is made already
+    int reduction(Move move, std::size_t index, int depth, int ply, bool inCheck) const;
+
+    Value alphaBeta(Value alpha, Value beta, int depth, int ply);
+
+    // resolves the captures at the leaves of alphaBeta()
+    Value quiescence(Value alpha, Value beta, int ply);
+
+    void iterativeDeepening();
+
+    // searches the remaining moves of the split point, together with the threads that joined
+    void searchSplitPoint(SplitPoint &sp);
+
+    // returns a split point of another thread with moves left, already joined;
+    // with below only one of the split points opened inside that one
+    SplitPoint * stealWork(const SplitPoint *below = nullptr);
+
+    // joins the split points below sp until all helpers of sp are done
+    void helpHelpers(SplitPoint &sp);
+
+    void helperLoop();
+
+    void checkLimits();
+
+    // adds the evaluation counters since the last call to the shared ones
+    void reportEvalStats();
+
+    inline bool cutoffOccurred() const {
+        for (const SplitPoint *sp = activeSplitPoint; sp; sp = sp->parent)
+            if (sp->cutoff.load(std::memory_order_relaxed))
+                return true;
+        return false;
+    }
+
+    // the first iteration always completes, so there is a move to play
+    inline bool stopped() const {
+        return (sr.request.depth > 1 && limits->stop.load(std::memory_order_relaxed))
+                || (activeSplitPoint && cutoffOccurred());
+    }
 
 protected:
 
@@ -40,16 +312,125 @@ protected:
 }; // !class MinimaxSearchThread
 
 
+/* Asynchronous search started by Search::start(), shared by the caller and the search */
+class SearchHandle {
+public:
+
+    // the search ends as soon as possible and reports its last completed iteration
+    void stop();
+
+    // blocks until the search ended and the result callback returned
+    void wait();
+
+    bool isFinished();
+
+    // waits for the end of the search
+    SearchResult result();
+
+private:
+
+    friend class Search;
+
+    explicit SearchHandle(SearchLimits *searchLimits)
+        : limits(searchLimits), finished(false) {}
+
+    void finish(const SearchResult &result);
+
+    SearchLimits *limits;
+    std::mutex mutex;
+    std::condition_variable finishedCv;
+    bool finished;
+    SearchResult searchResult;
+};
+
 class Search
 {
+public:
+
+    enum ParallelMode {
+        LazySmp,    // all threads search the whole tree at staggered depths, sharing the table
+        RootSplit,  // the root moves are split between the threads at each iteration
+        Ybwc        // young brothers wait: idle threads join the inner nodes of the main thread
+    };
+
+private:
+
+    TranspositionTable tt;  // shared by all threads
+    SearchLimits limits;
     Vector<MinimaxSearchThread*> threads;
+    ParallelMode parallelMode;
+    std::atomic<int> idleThreads;   // YBWC helpers waiting for work
+
+    // runs the asynchronous searches
+    class Driver : public AbstractThread {
+    public:
+        Search *search;
+        SearchRequest request;
+        SearchResultCallback onFinished;
+        SearchInfoCallback onInfo;
+        std::shared_ptr<SearchHandle> handle;
+    protected:
+        void run() override;
+    } driver;
+
+    const SearchInfoCallback *infoCallback;     // of the running search, may be null
+    bool warmStart;     // the last search was a ponder miss, its tables are kept as they are
 
 public:
 
-    Search(unsigned int threadsCount = std::thread::hardware_concurrency());
+    Search(unsigned int threadsCount = std::thread::hardware_concurrency(),
+           std::size_t hashMegabytes = TranspositionTable::DefaultSize);
 
+    // blocks until the search ends
     SearchResult search(SearchRequest request);
 
+    /* Searches in the background and returns immediately. onInfo is called
+     * after each completed iteration and onFinished with the result, both from
+     * the search thread. A running search is stopped first. */
+    std::shared_ptr<SearchHandle> start(const SearchRequest &request, SearchResultCallback onFinished,
+                                        SearchInfoCallback onInfo = SearchInfoCallback());
+
+    // stops the running search, if any, and waits for its end
+    void stop();
+
+    // the opponent played the expected move: the ponder search goes on as a normal search
+    void ponderHit();
+
+    // clears the table, must not be called while searching
+    void setHashSize(std::size_t megabytes);
+
+    // true if the system granted large pages for the table
+    bool hashUsesHugePages() const {
+        return tt.usesHugePages();
+    }
+
+    // must not be called while searching
+    void setParallelMode(ParallelMode mode);
+
+    ParallelMode getParallelMode() const {
+        return parallelMode;
+    }
+
+private:
+
+    friend class MinimaxSearchThread;
+
+    // the limits have to be started already
+    SearchResult run(const SearchRequest &request, const SearchInfoCallback *onInfo);
+
+    // called by the thread completing an iteration, scores from White's point of view
+    void reportIteration(int depth, const Vector<PvLine> &lines);
+
+    SearchResult searchLazySmp(const SearchRequest &request);
+
+    SearchResult searchRootSplit(const SearchRequest &request);
+
+    SearchResult searchYbwc(const SearchRequest &request);
+
+    // one fixed depth search of all root moves split between the threads
+    SearchResult searchIteration(const SearchRequest &request, const Vector<Vector<Move>> &threadMoves,
+                                 int depth, Value alpha, Value beta);
+
 }; // !class Search
 
 } //!namespace chess
@@ -0,0 +1,187 @@
+#include "transpositiontable.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace Chess {
+
+namespace {
+
+// | data bits meaning:                                      |
+// | ------------------------------------------------------- |
+// | Move  | Score  | Depth | Bound | Generation |           |
+// | 0-31  | 32-47  | 48-55 | 56-57 | 58-63      |           |
+
+// scores are stored exactly, they fit 16 bits
+inline std::uint64_t packData(Move move, Value score, int depth, int genBound) {
+    return std::uint64_t(move.pack())
+         | std::uint64_t(uint16(sint16(score))) << 32
+         | std::uint64_t(uint8(sint8(depth))) << 48
+         | std::uint64_t(uint8(genBound)) << 56;
+}
+
+inline Move  dataMove(std::uint64_t data)     { return Move::unpack(uint32(data)); }
+inline Value dataScore(std::uint64_t data)    { return sint16(uint16(data >> 32)); }
+inline int   dataDepth(std::uint64_t data)    { return sint8(uint8(data >> 48)); }
+inline int   dataBound(std::uint64_t data)    { return (data >> 56) & 0x3; }
+inline uint8 dataGen(std::uint64_t data)      { return uint8(data >> 58); }
+
+} // !anonymous namespace
+
+TranspositionTable::TranspositionTable(std::size_t megabytes)
+    : buckets(nullptr), bucketMask(0), hugePages(false), generation(0)
+{
+    resize(megabytes);
+}
+
+TranspositionTable::~TranspositionTable()
+{
+    deallocate();
+}
+
+void TranspositionTable::resize(std::size_t megabytes)
+{
+    std::size_t count = std::max<std::size_t>(megabytes, 1) * 1024 * 1024 / sizeof(Bucket);
+
+    // power of two, so the index is a mask of the key
+    std::size_t size = 1;
+    while (size * 2 <= count)
+        size *= 2;
+
+    deallocate();
+    allocate(size * sizeof(Bucket));
+    bucketMask = size - 1;
+    clear();
+}
+
+void TranspositionTable::clear()
+{
+    std::memset(static_cast<void*>(buckets), 0, (bucketMask + 1) * sizeof(Bucket));
+    generation = 0;
+}
+
+void TranspositionTable::newSearch()
+{
+    generation = (generation + 1) & 0x3F;
+}
+
+bool TranspositionTable::probe(Key key, Entry &entry) const
+{
+    const Bucket &b = bucket(key);
+    for (int i = 0; i < Bucket::Size; ++i) {
+        std::uint64_t data = b.entries[i].data.load(std::memory_order_relaxed);
+        std::uint64_t check = b.entries[i].keyXorData.load(std::memory_order_relaxed);
+        if ((check ^ data) != key || !data)
+            continue;
+
+        entry.move  = dataMove(data);
+        entry.score = dataScore(data);
+        entry.depth = dataDepth(data);
+        entry.bound = Bound(dataBound(data));
+        return true;
+    }
+    return false;
+}
+
+void TranspositionTable::store(Key key, Move move, Value score, int depth, Bound bound)
+{
+    Bucket &b = bucket(key);
+    Slot *replace = &b.entries[0];
+    int replaceWorth = 1 << 30;
+
+    for (int i = 0; i < Bucket::Size; ++i) {
+        Slot &slot = b.entries[i];
+        std::uint64_t data = slot.data.load(std::memory_order_relaxed);
+        std::uint64_t check = slot.keyXorData.load(std::memory_order_relaxed);
+
+        if (!data || (check ^ data) == key) {
+            // same position: keep the old best move if the new result has none
+            if (data && !move.isValid())
+                move = dataMove(data);
+            replace = &slot;
+            break;
+        }
+
+        // replace the shallowest entry, entries of older searches lose 8 plies of depth per generation
+        int age = (64 + generation - dataGen(data)) & 0x3F;
+        int worth = dataDepth(data) - 8 * age;
+        if (worth < replaceWorth) {
+            replaceWorth = worth;
+            replace = &slot;
+        }
+    }
+
+    std::uint64_t data = packData(move, score, depth, (generation << 2) | bound);
+    replace->data.store(data, std::memory_order_relaxed);
+    replace->keyXorData.store(key ^ data, std::memory_order_relaxed);
+}
+
+int TranspositionTable::hashfull() const
+{
+    int used = 0;
+    for (int i = 0; i < 1000 / Bucket::Size; ++i) {
+        for (int j = 0; j < Bucket::Size; ++j) {
+            std::uint64_t data = buckets[i].entries[j].data.load(std::memory_order_relaxed);
+            used += (data && dataGen(data) == generation);
+        }
+    }
+    return used * 1000 / (1000 / Bucket::Size * Bucket::Size);
+}
+
+/* Large pages cut the TLB misses of the random accesses into the table.
+ * They are a hint only, the table falls back to normal pages when the
+ * system refuses them. */
+void TranspositionTable::allocate(std::size_t bytes)
+{
+    hugePages = false;
+    void *memory = nullptr;
+
+#if defined(_WIN32)
+    SIZE_T largePage = GetLargePageMinimum();
+    if (largePage && bytes % largePage == 0) {
+        memory = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        hugePages = (memory != nullptr);
+    }
+    if (!memory)
+        memory = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#elif defined(__linux__)
+    constexpr std::size_t hugePageSize = 2 * 1024 * 1024;
+    std::size_t alignment = (bytes >= hugePageSize ? hugePageSize : alignof(Bucket));
+    if (posix_memalign(&memory, alignment, bytes) != 0)
+        memory = nullptr;
+#ifdef MADV_HUGEPAGE
+    if (memory && alignment == hugePageSize)
+        hugePages = (madvise(memory, bytes, MADV_HUGEPAGE) == 0);
+#endif
+#else
+    if (posix_memalign(&memory, alignof(Bucket), bytes) != 0)
+        memory = nullptr;
+#endif
+
+    if (!memory) {
+        qDebug() << "TranspositionTable::allocate() failed to allocate" << bytes << "bytes";
+        std::abort();
+    }
+    buckets = static_cast<Bucket*>(memory);
+}
+
+void TranspositionTable::deallocate()
+{
+    if (!buckets)
+        return;
+
+#if defined(_WIN32)
+    VirtualFree(buckets, 0, MEM_RELEASE);
+#else
+    std::free(buckets);
+#endif
+    buckets = nullptr;
+}
+
+} // !namespace Chess
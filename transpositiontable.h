@@ -0,0 +1,92 @@
+#ifndef TRANSPOSITIONTABLE_H
+#define TRANSPOSITIONTABLE_H
+
+#include "enginetypes.h"
+#include "zobrist.h"
+
+#include <atomic>
+#include <cstddef>
+
+namespace Chess {
+
+/* Fixed-size hash of search results shared by all search threads.
+ *
+ * Entries are written without locks: the key is stored xor-ed with the data
+ * word, so an entry torn by two threads writing at once fails verification
+ * and reads as a miss. Four entries form one 64 byte bucket, a probe touches
+ * a single cache line. */
+class TranspositionTable {
+public:
+
+    enum Bound {
+        NoBound    = 0,
+        UpperBound = 1,   // score <= stored score (fail low)
+        LowerBound = 2,   // score >= stored score (fail high)
+        ExactBound = UpperBound | LowerBound
+    };
+
+    struct Entry {
+        Move  move;
+        Value score;
+        int   depth;
+        Bound bound;
+    };
+
+    static constexpr std::size_t DefaultSize = 64; // MB
+
+    explicit TranspositionTable(std::size_t megabytes = DefaultSize);
+    ~TranspositionTable();
+
+    TranspositionTable(const TranspositionTable&) = delete;
+    TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+    // reallocates and clears the table, must not be called while searching
+    void resize(std::size_t megabytes);
+
+    void clear();
+
+    // ages the stored entries, they become the first to be replaced
+    void newSearch();
+
+    bool probe(Key key, Entry &entry) const;
+
+    void store(Key key, Move move, Value score, int depth, Bound bound);
+
+    // permille of the sampled entries written by the current search
+    int hashfull() const;
+
+    // true if the table is backed by large/huge pages
+    bool usesHugePages() const {
+        return hugePages;
+    }
+
+private:
+
+    struct Slot {
+        std::atomic<std::uint64_t> keyXorData;
+        std::atomic<std::uint64_t> data;
+    };
+
+    struct alignas(64) Bucket {
+        static constexpr int Size = 4;
+        Slot entries[Size];
+    };
+
+    static_assert(sizeof(Bucket) == 64, "TranspositionTable::Bucket must fill one cache line");
+
+    Bucket *buckets;
+    std::size_t bucketMask;
+    bool hugePages;
+    uint8 generation;   // 6 bits, packed together with the bound
+
+    inline Bucket & bucket(Key key) const {
+        return buckets[key & bucketMask];
+    }
+
+    void allocate(std::size_t bytes);
+    void deallocate();
+};
+
+} // !namespace Chess
+
+#endif // TRANSPOSITIONTABLE_H
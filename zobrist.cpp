@@ -0,0 +1,43 @@
+#include "zobrist.h"
+
+namespace Chess {
+namespace Zobrist {
+
+Key psq[2][7][64];
+Key castling[16];
+Key enPassantFile[8];
+Key side;
+
+namespace {
+
+/* fixed seed, keys have to be the same on every run */
+struct Initializer {
+    Initializer() {
+        std::uint64_t s = 1070372;
+        auto next = [&s]() { s ^= s >> 12; s ^= s << 25; s ^= s >> 27; return s * 2685821657736338717ULL; };
+
+        for (int color = 0; color < 2; ++color)
+            for (int type = Piece::Pawn; type <= Piece::King; ++type)
+                for (int square = 0; square < 64; ++square)
+                    psq[color][type][square] = next();
+
+        // the key of a set of rights is the xor of the keys of its single rights
+        Key single[4] = { next(), next(), next(), next() };
+        for (int rights = 0; rights < 16; ++rights) {
+            castling[rights] = 0;
+            for (int i = 0; i < 4; ++i)
+                if (rights & (1 << i))
+                    castling[rights] ^= single[i];
+        }
+
+        for (int file = 0; file < 8; ++file)
+            enPassantFile[file] = next();
+
+        side = next();
+    }
+} initializer;
+
+} // !anonymous namespace
+
+} // !namespace Zobrist
+} // !namespace Chess
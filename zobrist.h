@@ -0,0 +1,36 @@
+#ifndef ZOBRIST_H
+#define ZOBRIST_H
+
+#include "enginetypes.h"
+#include "bitboard.h"
+
+namespace Chess {
+
+using Key = std::uint64_t;
+
+namespace Zobrist {
+
+// king and rook home squares, castling rights can only change when a move touches them
+constexpr Bitboard CastlingSquares = (1ULL << 0) | (1ULL << 4) | (1ULL << 7)
+                                   | (1ULL << 56) | (1ULL << 60) | (1ULL << 63);
+
+enum CastlingRight {
+    WhiteKingSide  = (1<<0),
+    WhiteQueenSide = (1<<1),
+    BlackKingSide  = (1<<2),
+    BlackQueenSide = (1<<3)
+};
+
+extern Key psq[2][7][64];      // [color][type][square], all zero for Piece::Empty
+extern Key castling[16];       // indexed by a CastlingRight mask
+extern Key enPassantFile[8];
+extern Key side;               // black to move
+
+inline Key piece(Piece piece, Coord square) {
+    return psq[piece.color()][piece.type()][square];
+}
+
+} // !namespace Zobrist
+} // !namespace Chess
+
+#endif // ZOBRIST_H